@@ -1,15 +1,66 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <vector>
 #include <GL/glut.h>
+#include "BallPhysics.h"
+#include "CoreRenderer.h"
+#include "Frustum.h"
+#include "MeshCache.h"
+#include "Offscreen.h"
+#include "Profiler.h"
+#include "TextureCache.h"
+
+/* Command line:
+    --balls N           number of balls (default 1), past a few hundred they shrink to fit the room
+    --seed N            seed for the ball positions and directions (default: current time)
+    --dt S              physics step in seconds (default 1/60), continuous collisions keep big steps from tunneling
+    --no-ccd            collide balls only where they overlap after each step, like before
+    --wall-subdiv N     split every wall into N x N quads for smoother per vertex lighting (default 1)
+    --legacy-walls      draw the walls with glBegin/glEnd every frame instead of the room vertex buffer
+    --sphere-detail N   slices and stacks of the ball spheres up close (default 32)
+    --no-lod            draw every ball at full detail instead of coarser the smaller it is on screen
+    --no-culling        draw every ball instead of skipping the ones outside the view frustum
+    --legacy-geometry   tessellate every ball with glutSolidSphere/gluSphere each frame instead of the cached mesh
+    --core-profile      draw through a gl 3.3 core context with per pixel lighting from uniform buffers (CoreRenderer.h)
+                        instead of the fixed function pipeline, --legacy-walls and --legacy-geometry do not apply
+    --threads N         threads for the ball collisions (default: one per core)
+    --bench-physics     time the ball simulation at 1k, 10k and 100k balls, then 100k on 1 to 16 threads,
+                        then 10k with steps from 1/240 to 1/4 s with and without continuous collisions, and exit
+    --offscreen N       render N frames into an egl pbuffer and print each frame's render time (offscreen build)
+    --dump-frames PATH  with --offscreen, also write the frames to PATH0000.ppm, PATH0001.ppm, ...
+    --mip-filter F      box (default), kaiser, or off for plain GL_LINEAR without mipmaps
+    --anisotropy N      anisotropic filtering up to N samples (default 1 = off)
+    --no-compressed     ignore the block compressed .ktx textures from TextureCompressor
+
+   Build:           g++ BallIn3DRoom.cpp -lglut -lGLU -lGL -pthread
+   Offscreen build: g++ -DOFFSCREEN BallIn3DRoom.cpp -lglut -lGLU -lGL -lEGL -pthread
+*/
 
 // room dimensions
+const int WINDOW_WIDTH = 800;
+const int WINDOW_HEIGHT = 600;
+const float FIELD_OF_VIEW = 60.0f; // vertical, degrees
 const float ROOM_SIZE = 10.0f;
 const float BALL_RADIUS = 0.5f;
+const float BALL_SPEED = 6.0f; // units per second
+const float FRAME_DT = 1.0f / 60.0f; // simulated time per frame
 
-// ball properties
-float ballPos[3] = { 0, BALL_RADIUS, 0 };
-// y is 0 because we dont want our ball to fly 
-float ballVelocity[3] = { 0.1f, 0.0f, 0.1f };
+// ball properties, see BallPhysics.h
+BallWorld balls;
+int ballCount = 1;
+int physicsThreads = 0;
+float physicsDt = FRAME_DT;  // one physics step, frames take as many as fit
+double physicsClock = 0.0;   // simulated time not stepped yet
+uint64_t seed = 0;
 
 // camera properties
 // camera's x, y and z
@@ -18,37 +69,115 @@ float cameraPos[3] = { 0, ROOM_SIZE / 2, ROOM_SIZE };
 float lookAt[3] = { 0, 0, 0 };
 // determine which axes is up i think too
 float up[3] = { 0, 1, 0 };
+const float Z_NEAR = 0.1f;
+const float Z_FAR = 100.0f;
 
 GLuint textures[6];
 
+// the whole room in one mesh (one vertex buffer, one draw), see buildRoom()
+Mesh roomMesh;
+int wallSubdivisions = 1;
+bool legacyWalls = false;
+double wallSubmitMs = 0.0; // cpu time spent in drawWalls(), summed over frames
+void drawWallsLegacy();
+
+// ball spheres come from the mesh cache, tessellated sphereDetail x sphereDetail
+// up close and coarser the smaller they are on screen
+MeshCache meshCache;
+SphereLod ballLod;
+std::vector<unsigned char> ballLevels; // lod level per ball this frame
+int sphereDetail = 32;
+bool legacyGeometry = false;
+double ballSubmitMs = 0.0; // cpu time spent in drawBalls(), summed over frames
+
+// balls entirely outside the camera's view are skipped, see Frustum.h
+Frustum viewFrustum;
+bool frustumCulling = true;
+std::vector<unsigned char> ballVisible; // 1 if ball i is drawn this frame
+long long ballsDrawn = 0, ballsCulled = 0;
+
 // lighting
 GLfloat light_position[] = { ROOM_SIZE, ROOM_SIZE, ROOM_SIZE, 1.0f };
 
-void loadTexture(const char* filename, GLuint textureID) {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    // upload to GPU memory
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    // texture set to repeat
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // x
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); // y
-    // linear: mix between colors near the center to cover the rest of the texture
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// core profile renderer, the same light and materials as the fixed function
+// state: light 0 defaults, color material with the default white color and
+// the balls' specular, which the walls also keep after the first frame
+bool coreProfile = false;
+CoreRenderer coreRenderer;
+Mat4 viewMatrix;
+GLuint ballInstanceBuffer = 0;
+std::vector<float> ballInstanceData;
+std::vector<int> ballLevelInstances; // per lod level, keeps its capacity across frames
+void drawBallsInstanced();
+const CoreLight ROOM_LIGHT = {
+    { ROOM_SIZE, ROOM_SIZE, ROOM_SIZE, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f },
+};
+const float SCENE_AMBIENT[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
+const CoreMaterial ROOM_MATERIAL = {
+    { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, 100.0f,
+};
+
+// offscreen rendering (egl, no window). glut must not be called in this mode
+bool offscreen = false;
+GetProcAddressFn glProcSource = glutProcAddress;
 
-    // free memory
-    stbi_image_free(image);
+void initTextures() {
+    // shared loader, see TextureCache.h
+    textures[0] = textureCache.load("golden-leaves-texture.jpg"); // i have one texture only
+    textureCache.printStats();
 }
 
-void initTextures() {
-    // generate the textures IDs
-    glGenTextures(6, textures);
-    loadTexture("golden-leaves-texture.jpg", textures[0]); // i have one texture only
+// floor, ceiling and the four walls as one mesh, with the same corners and
+// texture coordinates as drawWallsLegacy() and normals facing into the room
+void buildRoom() {
+    const float S = ROOM_SIZE;
+    struct Face {
+        float corners[4][3];
+        float texCoords[4][2];
+        float normal[3];
+    };
+    const Face faces[6] = {
+        // floor, the texture repeats 10 times
+        { { { -S, 0, -S }, { S, 0, -S }, { S, 0, S }, { -S, 0, S } }, { { 0, 0 }, { 10, 0 }, { 10, 10 }, { 0, 10 } }, { 0, 1, 0 } },
+        // ceiling
+        { { { -S, S, -S }, { -S, S, S }, { S, S, S }, { S, S, -S } }, { { 0, 1 }, { 0, 0 }, { 1, 0 }, { 1, 1 } }, { 0, -1, 0 } },
+        // front wall
+        { { { -S, 0, S }, { S, 0, S }, { S, S, S }, { -S, S, S } }, { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } }, { 0, 0, -1 } },
+        // back wall
+        { { { -S, 0, -S }, { S, 0, -S }, { S, S, -S }, { -S, S, -S } }, { { 1, 0 }, { 0, 0 }, { 0, 1 }, { 1, 1 } }, { 0, 0, 1 } },
+        // left wall
+        { { { -S, 0, -S }, { -S, 0, S }, { -S, S, S }, { -S, S, -S } }, { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } }, { 1, 0, 0 } },
+        // right wall
+        { { { S, 0, -S }, { S, 0, S }, { S, S, S }, { S, S, -S } }, { { 1, 0 }, { 0, 0 }, { 0, 1 }, { 1, 1 } }, { -1, 0, 0 } },
+    };
+
+    roomMesh = Mesh();
+    for (const Face& face : faces) {
+        addQuadGrid(roomMesh, face.corners, face.texCoords, face.normal, wallSubdivisions);
+    }
+    uploadMesh(roomMesh);
 }
 
 void drawWalls() {
+    auto start = std::chrono::steady_clock::now();
+    if (coreProfile) {
+        coreRenderer.drawMesh(roomMesh, viewMatrix, ROOM_MATERIAL, textures[0]);
+    }
+    else if (legacyWalls) {
+        drawWallsLegacy();
+    }
+    else {
+        // one texture for the whole room, so one bind and one draw call
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        drawMesh(roomMesh);
+        glDisable(GL_TEXTURE_2D);
+    }
+    wallSubmitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the original walls: six glBegin/glEnd quads every frame (--legacy-walls)
+void drawWallsLegacy() {
     glEnable(GL_TEXTURE_2D);
 
     // floor
@@ -108,58 +237,255 @@ void drawWalls() {
     glDisable(GL_TEXTURE_2D);
 }
 
-void drawBall() {
+void drawBalls() {
     GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
     GLfloat mat_shininess[] = { 100.0 };
 
     // specular lighting
-    glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-    glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
+    if (!coreProfile) {
+        glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
+        glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ballVisible.resize(balls.size());
+    int visible = balls.size();
+    if (frustumCulling)
+        visible = cullSpheres(viewFrustum, balls.x.data(), balls.y.data(), balls.z.data(), balls.radius.data(), balls.size(), ballVisible.data());
+    else
+        std::fill(ballVisible.begin(), ballVisible.end(), 1);
+    ballsDrawn += visible;
+    ballsCulled += balls.size() - visible;
+
+    if (legacyGeometry) {
+        // glut refuses to draw without a window, glu has the same sphere
+        static GLUquadricObj* sphere = nullptr;
+        if (offscreen && !sphere) sphere = gluNewQuadric();
+
+        for (int i = 0; i < balls.size(); i++) {
+            if (!ballVisible[i]) continue;
+            // so translation does not affect 
+            glPushMatrix();
+            glTranslatef(balls.x[i], balls.y[i], balls.z[i]);
+            // higher values = smoother sphere
+            if (offscreen)
+                gluSphere(sphere, balls.radius[i], sphereDetail, sphereDetail);
+            else
+                glutSolidSphere(balls.radius[i], sphereDetail, sphereDetail);
+            // reset the translatef (like we used to do in assembly yarab el sabr)
+            glPopMatrix();
+        }
+    }
+    else {
+        // the unit spheres are built once, every ball only costs a transform
+        // and a draw. balls are grouped by level so each mesh is bound once
+        ballLevels.resize(balls.size());
+        for (int i = 0; i < balls.size(); i++) {
+            if (!ballVisible[i]) continue;
+            float dx = balls.x[i] - cameraPos[0], dy = balls.y[i] - cameraPos[1], dz = balls.z[i] - cameraPos[2];
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            ballLevels[i] = static_cast<unsigned char>(ballLod.pick(projectedRadius(balls.radius[i], distance, FIELD_OF_VIEW, WINDOW_HEIGHT)));
+        }
+
+        if (coreProfile) {
+            drawBallsInstanced();
+            ballSubmitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return;
+        }
+
+        for (int level = 0; level < ballLod.levels(); level++) {
+            const Mesh& sphere = ballLod.mesh(level);
+            bool bound = false;
+            for (int i = 0; i < balls.size(); i++) {
+                if (!ballVisible[i] || ballLevels[i] != level) continue;
+                if (!bound) {
+                    bindMesh(sphere);
+                    bound = true;
+                }
+                glPushMatrix();
+                glTranslatef(balls.x[i], balls.y[i], balls.z[i]);
+                glScalef(balls.radius[i], balls.radius[i], balls.radius[i]);
+                drawMeshElements(sphere);
+                glPopMatrix();
+                ballLod.countDrawn(level);
+            }
+            if (bound) unbindMesh(sphere);
+        }
+    }
+    ballSubmitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-    // so translation does not affect 
-    glPushMatrix();
-    glTranslatef(ballPos[0], ballPos[1], ballPos[2]);
-    // higher values = smoother sphere
-    glutSolidSphere(BALL_RADIUS, 32, 32);
-    // reset the translatef (like we used to do in assembly yarab el sabr)
-    glPopMatrix();
+// core profile: every visible ball's position and radius go into one
+// buffer grouped by lod level, then one instanced draw per level
+void drawBallsInstanced() {
+    std::vector<int>& levelInstances = ballLevelInstances;
+    levelInstances.assign(ballLod.levels(), 0);
+    ballInstanceData.clear();
+    for (int level = 0; level < ballLod.levels(); level++) {
+        for (int i = 0; i < balls.size(); i++) {
+            if (!ballVisible[i] || ballLevels[i] != level) continue;
+            float instance[INSTANCE_OFFSET_SCALE_FLOATS] = { balls.x[i], balls.y[i], balls.z[i], balls.radius[i] };
+            ballInstanceData.insert(ballInstanceData.end(), instance, instance + INSTANCE_OFFSET_SCALE_FLOATS);
+            levelInstances[level]++;
+        }
+    }
+
+    // orphan and refill every frame
+    glext.bindBuffer(GL_ARRAY_BUFFER, ballInstanceBuffer);
+    glext.bufferData(GL_ARRAY_BUFFER, ballInstanceData.size() * sizeof(float), ballInstanceData.data(), GL_STREAM_DRAW);
+    glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    int firstInstance = 0;
+    for (int level = 0; level < ballLod.levels(); level++) {
+        coreRenderer.drawMeshInstanced(ballLod.mesh(level), ballInstanceBuffer, firstInstance, levelInstances[level],
+            viewMatrix, ROOM_MATERIAL, 0);
+        ballLod.countDrawn(level, levelInstances[level]);
+        firstInstance += levelInstances[level];
+    }
 }
 
-const float DRIFT_STRENGTH = 0.15f; 
+// the room: floor at 0, ceiling at ROOM_SIZE, walls at +-ROOM_SIZE
+void initBalls() {
+    balls.clear();
+    balls.setThreads(physicsThreads);
+    balls.setBounds(-ROOM_SIZE, 0, -ROOM_SIZE, ROOM_SIZE, ROOM_SIZE, ROOM_SIZE);
+    if (ballCount == 1) {
+        // the original ball: rolls along the floor, y is 0 because we dont want our ball to fly
+        balls.add(0, BALL_RADIUS, 0, BALL_SPEED, 0, BALL_SPEED, BALL_RADIUS);
+        return;
+    }
+    Pcg32 random(seed, 1);
+    balls.scatter(ballCount, balls.fittingRadius(ballCount, BALL_RADIUS), BALL_SPEED, random);
+}
 
-void updateBall() {
-    for (int i = 0; i < 3; i++) {
-        ballPos[i] += ballVelocity[i];
+void updateBalls() {
+    // walls bounce without the old drift, so the speed no longer grows forever
+    physicsClock += FRAME_DT;
+    while (physicsClock >= physicsDt) {
+        balls.step(physicsDt);
+        physicsClock -= physicsDt;
+    }
+}
 
-        if (ballPos[i] + BALL_RADIUS > ROOM_SIZE || ballPos[i] - BALL_RADIUS < -ROOM_SIZE) {
-            // reverse velocity
-            ballVelocity[i] *= -1;
+// relative change since start, rounding only, anything big means a bug
+void printEnergyCheck(double start, double end) {
+    double drift = start > 0.0 ? (end - start) / start : 0.0;
+    printf("energy:      %.6g -> %.6g (drift %.2e)%s\n", start, end, drift, std::fabs(drift) > 1e-3 ? " NOT CONSERVED" : "");
+}
 
-            // apply simple drift ro z axes so it feels random
-            // i think i am increasing the velocity infinitly but that is a problem for another day
-            ballVelocity[2] += DRIFT_STRENGTH;
+// fnv-1a over every position and velocity bit, equal hashes mean the runs
+// ended in exactly the same state
+uint64_t hashBallState() {
+    uint64_t hash = 14695981039346656037ull;
+    for (const std::vector<float>* values : { &balls.x, &balls.y, &balls.z, &balls.vx, &balls.vy, &balls.vz }) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values->data());
+        for (size_t i = 0; i < values->size() * sizeof(float); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// steps 1k, 10k and 100k balls headless, then the 100k run again on 1 to 16
+// threads. every thread count has to end with the same state hash
+void runPhysicsBenchmark() {
+    const int sizes[] = { 1000, 10000, 100000 };
+    const int threadCounts[] = { 1, 2, 4, 8, 16 };
+    const double ballStepsPerRun = 2e6;
+
+    std::cout << "balls    radius   steps   ms/step   pair tests/step   ball hits/step   wall hits/step   energy drift\n";
+    for (int count : sizes) {
+        ballCount = count;
+        initBalls();
+        int steps = static_cast<int>(std::min(600.0, ballStepsPerRun / count));
+        double startEnergy = balls.kineticEnergy();
+
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; s++) {
+            balls.step(FRAME_DT);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+        double drift = (balls.kineticEnergy() - startEnergy) / startEnergy;
+
+        printf("%6d   %6.3f   %5d   %7.2f   %15.3g   %14.1f   %14.1f   %12.2e\n", count, balls.radius[0], steps, ms,
+            static_cast<double>(balls.pairTests) / steps, static_cast<double>(balls.ballHits) / steps,
+            static_cast<double>(balls.wallHits) / steps, drift);
+    }
 
-            // clamp position to prevent glitches "it skipped walls :')"
-            ballPos[i] = (ballPos[i] > 0) ?
-                ROOM_SIZE - BALL_RADIUS :
-                -ROOM_SIZE + BALL_RADIUS;
+    std::cout << "\n" << sizes[2] << " balls, " << std::thread::hardware_concurrency() << " hardware threads\n";
+    std::cout << "threads   ms/step   speedup   steals/step   state hash\n";
+    double baseMs = 0.0;
+    int savedThreads = physicsThreads;
+    for (int threads : threadCounts) {
+        physicsThreads = threads;
+        ballCount = sizes[2];
+        initBalls();
+        int steps = static_cast<int>(ballStepsPerRun / ballCount);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; s++) {
+            balls.step(FRAME_DT);
         }
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+        if (threads == 1) baseMs = ms;
+        printf("%7d   %7.2f   %6.2fx   %11.1f   %016llx\n", threads, ms, baseMs / ms,
+            static_cast<double>(balls.steals()) / steps, static_cast<unsigned long long>(hashBallState()));
     }
+    physicsThreads = savedThreads;
+
+    // the same 2 simulated seconds in steps of every size. a discrete step
+    // only sees pairs that overlap at its end, so as steps grow it misses
+    // more of the hits, the continuous one should count about the same
+    // number at every size
+    const float stepSizes[] = { 1.0f / 240, 1.0f / 60, 1.0f / 15, 1.0f / 4 };
+    const float simulatedSeconds = 2.0f;
+    bool savedContinuous = balls.continuous;
+    std::cout << "\n" << sizes[1] << " balls, " << simulatedSeconds << " simulated seconds\n";
+    std::cout << "      dt   collisions   steps   ms/step   sim s/wall s   ball hits/sim s   energy drift\n";
+    for (float dt : stepSizes) {
+        for (bool continuous : { false, true }) {
+            ballCount = sizes[1];
+            initBalls();
+            balls.continuous = continuous;
+            int steps = static_cast<int>(simulatedSeconds / dt + 0.5f);
+            double startEnergy = balls.kineticEnergy();
+
+            auto start = std::chrono::steady_clock::now();
+            for (int s = 0; s < steps; s++) {
+                balls.step(dt);
+            }
+            auto end = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(end - start).count();
+            double drift = (balls.kineticEnergy() - startEnergy) / startEnergy;
+            printf("%8.4f   %10s   %5d   %7.2f   %12.1f   %15.0f   %12.2e\n", dt, continuous ? "continuous" : "discrete",
+                steps, seconds * 1000.0 / steps, simulatedSeconds / seconds, balls.ballHits / simulatedSeconds, drift);
+        }
+    }
+    balls.continuous = savedContinuous;
 }
 
 void display() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity();
-
-    gluLookAt(
-        cameraPos[0], cameraPos[1], cameraPos[2],
-        lookAt[0], lookAt[1], lookAt[2],
-        up[0], up[1], up[2]);
+    if (coreProfile) {
+        viewMatrix = lookAtMatrix(cameraPos, lookAt, up);
+        coreRenderer.beginFrame(perspectiveMatrix(FIELD_OF_VIEW, 1.0f, Z_NEAR, Z_FAR), ROOM_LIGHT, SCENE_AMBIENT);
+    }
+    else {
+        glLoadIdentity();
+        gluLookAt(
+            cameraPos[0], cameraPos[1], cameraPos[2],
+            lookAt[0], lookAt[1], lookAt[2],
+            up[0], up[1], up[2]);
+    }
+    viewFrustum = makeFrustum(cameraPos, lookAt, up, FIELD_OF_VIEW, 1.0f, Z_NEAR, Z_FAR);
 
     drawWalls();
-    drawBall();
+    drawBalls();
 
-    glutSwapBuffers();
+    if (!offscreen)
+        glutSwapBuffers();
 }
 
 void keyboard(unsigned char key, int x, int y) {
@@ -196,37 +522,205 @@ void specialKeys(int key, int x, int y) {
     glutPostRedisplay();
 }
 
-void init() {
-    // enable depth, lightining, light 0
+// false if --core-profile did not get a core context
+bool init() {
+    // compressed texture support is checked through these
+    loadGLExtensions(glProcSource);
     glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-    glEnable(GL_COLOR_MATERIAL);
+    if (coreProfile) {
+        if (!coreRenderer.init()) return false;
+        glext.genBuffers(1, &ballInstanceBuffer);
+    }
+
+    if (!coreProfile) {
+        // enable lightining, light 0
+        glEnable(GL_LIGHTING);
+        glEnable(GL_LIGHT0);
+        glEnable(GL_COLOR_MATERIAL);
+        // the cached sphere is a unit sphere scaled per ball, normals have to be rescaled
+        glEnable(GL_NORMALIZE);
 
-    // for the light 0, the parameter GL_POSITION, we gave it our light position
-    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+        // for the light 0, the parameter GL_POSITION, we gave it our light position
+        glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+    }
 
     initTextures();
+    buildRoom();
+    ballLod.init(meshCache, sphereDetail);
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-    glMatrixMode(GL_PROJECTION);
-    // 60 is eye angle
-    gluPerspective(60, 1.0, 0.1, 100.0);
-    glMatrixMode(GL_MODELVIEW);
+    if (!coreProfile) {
+        glMatrixMode(GL_PROJECTION);
+        // 60 is eye angle
+        gluPerspective(FIELD_OF_VIEW, 1.0, Z_NEAR, Z_FAR);
+        glMatrixMode(GL_MODELVIEW);
+    }
+    return true;
 }
 
 void update(int v) {
-    updateBall();
+    updateBalls();
     glutPostRedisplay();
     glutTimerFunc(16, update, 0);
 }
 
+// renders into an egl pbuffer, one update per frame, and times every frame
+// from the start of display() until the gpu (or llvmpipe) is done
+bool runOffscreen(int frames, const char* dumpFramesPrefix) {
+#ifdef OFFSCREEN
+    if (!createOffscreenContext(WINDOW_WIDTH, WINDOW_HEIGHT, coreProfile)) return false;
+    offscreen = true;
+    glProcSource = eglProcAddress;
+
+    if (!init()) return false;
+    std::cout << "renderer:    " << glGetString(GL_RENDERER) << std::endl;
+    std::cout << "pipeline:    " << (coreProfile ? "gl 3.3 core, per pixel phong" : "fixed function") << std::endl;
+
+    double startEnergy = balls.kineticEnergy();
+    std::vector<double> frameTimes;
+    for (int frame = 0; frame < frames; frame++) {
+        updateBalls();
+
+        auto start = std::chrono::steady_clock::now();
+        display();
+        glFinish();
+        auto end = std::chrono::steady_clock::now();
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        // frame 0 pays for driver warm up (shader variants, buffer uploads), keep it out of the wall numbers
+        if (frame == 0) {
+            wallSubmitMs = ballSubmitMs = 0.0;
+            ballLod.trianglesDrawn = ballLod.trianglesFull = 0;
+            ballsDrawn = ballsCulled = 0;
+            coreRenderer.objects = 0;
+        }
+        printf("frame %d: %.3f ms\n", frame, frameTimes.back());
+
+        if (dumpFramesPrefix) {
+            char filename[512];
+            snprintf(filename, sizeof(filename), "%s%04d.ppm", dumpFramesPrefix, frame);
+            writeFramePPM(filename, WINDOW_WIDTH, WINDOW_HEIGHT);
+        }
+    }
+    printFrameTimeSummary(frameTimes);
+    printFrameTimeHistogram(frameTimes);
+    if (legacyWalls) {
+        printf("walls:       immediate mode, 6 quads, %.1f us/frame to submit\n", wallSubmitMs * 1000.0 / std::max(1, frames - 1));
+    }
+    else {
+        printf("walls:       %s, %d triangles in 1 draw, %.1f us/frame to submit\n", roomMesh.vbo ? "vertex buffer" : "vertex array",
+            static_cast<int>(roomMesh.indices.size() / 3), wallSubmitMs * 1000.0 / std::max(1, frames - 1));
+    }
+    int timedFrames = std::max(1, frames - 1);
+    printf("balls:       %d %s, %dx%d, %.1f us/frame to submit\n", balls.size(), legacyGeometry ? "glu/glut spheres" : "cached meshes",
+        sphereDetail, sphereDetail, ballSubmitMs * 1000.0 / timedFrames);
+    if (!legacyGeometry) {
+        printf("ball lod:    %s, %d levels down to %dx%d, %lld triangles/frame (%lld at full detail)\n",
+            ballLod.enabled ? "on" : "off", ballLod.levels(), ballLod.detail(ballLod.levels() - 1), ballLod.detail(ballLod.levels() - 1),
+            ballLod.trianglesDrawn / timedFrames, ballLod.trianglesFull / timedFrames);
+    }
+    printf("culling:     %s (%s), %lld balls/frame drawn, %lld culled\n", frustumCulling ? "on" : "off", frustumCullName(),
+        ballsDrawn / timedFrames, ballsCulled / timedFrames);
+    if (coreProfile) {
+        printf("core:        %lld object blocks/frame\n", coreRenderer.objects / timedFrames);
+    }
+    printEnergyCheck(startEnergy, balls.kineticEnergy());
+    return true;
+#else
+    (void)frames;
+    (void)dumpFramesPrefix;
+    std::cout << "--offscreen needs a build with -DOFFSCREEN (and -lEGL)" << std::endl;
+    return false;
+#endif
+}
+
 int main(int argc, char** argv) {
+    int offscreenFrames = 0;
+    const char* dumpFramesPrefix = nullptr;
+    bool benchPhysics = false;
+    seed = static_cast<uint64_t>(time(nullptr));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--balls") == 0 && i + 1 < argc) {
+            ballCount = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+            physicsDt = std::max(1e-4f, static_cast<float>(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--no-ccd") == 0) {
+            balls.continuous = false;
+        }
+        else if (strcmp(argv[i], "--wall-subdiv") == 0 && i + 1 < argc) {
+            wallSubdivisions = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--legacy-walls") == 0) {
+            legacyWalls = true;
+        }
+        else if (strcmp(argv[i], "--sphere-detail") == 0 && i + 1 < argc) {
+            sphereDetail = std::max(3, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--no-lod") == 0) {
+            ballLod.enabled = false;
+        }
+        else if (strcmp(argv[i], "--no-culling") == 0) {
+            frustumCulling = false;
+        }
+        else if (strcmp(argv[i], "--legacy-geometry") == 0) {
+            legacyGeometry = true;
+        }
+        else if (strcmp(argv[i], "--core-profile") == 0) {
+            coreProfile = true;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            physicsThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench-physics") == 0) {
+            benchPhysics = true;
+        }
+        else if (strcmp(argv[i], "--offscreen") == 0 && i + 1 < argc) {
+            offscreenFrames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc) {
+            dumpFramesPrefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc) {
+            const char* filter = argv[++i];
+            textureCache.sampling.mipmaps = strcmp(filter, "off") != 0;
+            textureCache.sampling.mipFilter = strcmp(filter, "kaiser") == 0 ? MIP_FILTER_KAISER : MIP_FILTER_BOX;
+        }
+        else if (strcmp(argv[i], "--anisotropy") == 0 && i + 1 < argc) {
+            textureCache.sampling.anisotropy = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--no-compressed") == 0) {
+            textureCache.sampling.compressed = false;
+        }
+    }
+
+    if (coreProfile && (legacyWalls || legacyGeometry)) {
+        std::cout << "--core-profile has no immediate mode, ignoring --legacy-walls and --legacy-geometry" << std::endl;
+        legacyWalls = legacyGeometry = false;
+    }
+
+    if (benchPhysics) {
+        runPhysicsBenchmark();
+        return 0;
+    }
+    initBalls();
+
+    if (offscreenFrames > 0) {
+        return runOffscreen(offscreenFrames, dumpFramesPrefix) ? 0 : 1;
+    }
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(800, 600);
+    glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (coreProfile) {
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+    }
     glutCreateWindow("3D Room");
 
-    init();
+    if (!init()) return 1;
 
     glutDisplayFunc(display);
     glutKeyboardFunc(keyboard);
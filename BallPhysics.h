@@ -0,0 +1,496 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+#include "Random.h"
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+
+// balls bouncing around an axis aligned box. every property is its own array
+// (soa), so the loops over all balls only pull in the components they use.
+// velocities are in units per second. walls reflect and ball pairs collide
+// elastically, nothing else adds or removes energy, so kineticEnergy() only
+// moves by float rounding. no gl in here, it runs headless.
+// contacts are found through a grid and tested on every thread, then
+// resolved on one thread in a fixed order, so the result is the same for
+// any thread count
+class BallWorld {
+public:
+    // the cells are cut into this many ranges for the threads to share,
+    // fixed so the contact order never depends on the thread count
+    static const int NARROW_PHASE_TASKS = 256;
+
+    // the broad phase grid's cells are made this much bigger than the
+    // biggest swept sphere needs when they are rebuilt
+    static constexpr float GRID_HEADROOM = 1.1f;
+
+    // a continuous sweep moves no ball more than this many of its radii,
+    // longer steps are split into up to MAX_SWEEP_PIECES sweeps
+    static constexpr float MAX_SWEEP_RADII = 2.0f;
+    static const int MAX_SWEEP_PIECES = 64;
+
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> radius;
+    std::vector<float> inverseMass;
+
+    // counters, add up over every step
+    long long pairTests = 0;
+    long long ballHits = 0;
+    long long wallHits = 0;
+
+    void setBounds(float minX, float minY, float minZ, float maxX, float maxY, float maxZ) {
+        boundsMin[0] = minX; boundsMin[1] = minY; boundsMin[2] = minZ;
+        boundsMax[0] = maxX; boundsMax[1] = maxY; boundsMax[2] = maxZ;
+        gridReach = 0.0f;
+    }
+
+    int size() const { return static_cast<int>(x.size()); }
+
+    // 0 = one per hardware thread
+    void setThreads(int threads) {
+        pool.reset(new WorkStealingPool(threads));
+    }
+
+    int threads() const { return pool ? pool->size() : 1; }
+    long long steals() const { return pool ? pool->steals() : 0; }
+
+    void clear() {
+        for (auto* v : { &x, &y, &z, &vx, &vy, &vz, &radius, &inverseMass }) v->clear();
+        pairTests = ballHits = wallHits = 0;
+    }
+
+    // mass goes with volume (density 1, the 4/3 pi cancels out of every impulse)
+    void add(float px, float py, float pz, float velocityX, float velocityY, float velocityZ, float r) {
+        x.push_back(px); y.push_back(py); z.push_back(pz);
+        vx.push_back(velocityX); vy.push_back(velocityY); vz.push_back(velocityZ);
+        radius.push_back(r);
+        inverseMass.push_back(1.0f / (r * r * r));
+    }
+
+    // the biggest radius up to maxRadius at which count balls fill about
+    // fill of the box, so big counts still have room to move
+    float fittingRadius(int count, float maxRadius, float fill = 0.15f) const {
+        float volume = (boundsMax[0] - boundsMin[0]) * (boundsMax[1] - boundsMin[1]) * (boundsMax[2] - boundsMin[2]);
+        float r = std::cbrt(volume * fill / (count * 4.18879f));
+        return std::min(r, maxRadius);
+    }
+
+    // count balls of radius r on a jittered lattice (no overlaps to start
+    // with) flying in random directions at speed
+    void scatter(int count, float r, float speed, Pcg32& random) {
+        float extent[3];
+        for (int axis = 0; axis < 3; axis++) extent[axis] = boundsMax[axis] - boundsMin[axis];
+        float spacing = std::cbrt(extent[0] * extent[1] * extent[2] / count);
+        int cells[3];
+        for (;;) {
+            for (int axis = 0; axis < 3; axis++) cells[axis] = std::max(1, static_cast<int>(extent[axis] / spacing));
+            if (static_cast<long long>(cells[0]) * cells[1] * cells[2] >= count || spacing <= 2.0f * r) break;
+            spacing = std::max(spacing * 0.98f, 2.0f * r);
+        }
+
+        for (int i = 0; i < count; i++) {
+            int cell[3] = { i % cells[0], (i / cells[0]) % cells[1], i / (cells[0] * cells[1]) };
+            float position[3];
+            for (int axis = 0; axis < 3; axis++) {
+                float size = extent[axis] / cells[axis];
+                float jitter = std::max(0.0f, size / 2 - r);
+                position[axis] = boundsMin[axis] + (cell[axis] + 0.5f) * size + random.range(-jitter, jitter);
+            }
+
+            // direction uniform on the sphere: a point in the unit ball, normalized
+            float dx, dy, dz, length2;
+            do {
+                dx = random.range(-1, 1);
+                dy = random.range(-1, 1);
+                dz = random.range(-1, 1);
+                length2 = dx * dx + dy * dy + dz * dz;
+            } while (length2 > 1.0f || length2 < 1e-4f);
+            float scale = speed / std::sqrt(length2);
+            add(position[0], position[1], position[2], dx * scale, dy * scale, dz * scale, r);
+        }
+    }
+
+    // continuous collisions: the balls move along their paths and every
+    // touch inside the step is found at its time, so no step is too big to
+    // tunnel. off, pairs only collide when they overlap after the move
+    bool continuous = true;
+
+    void step(float dt) {
+        if (continuous) {
+            // a long sweep drags every ball's path across many others and the
+            // candidates grow with its square, so big steps are cut into
+            // pieces no ball moves more than a few radii in
+            int pieces = sweepPieces(dt);
+            for (int piece = 0; piece < pieces; piece++) {
+                sweepPairs(dt / pieces);
+                if (piece + 1 < pieces) collideWalls();
+            }
+        }
+        else {
+            integrate(dt);
+            collidePairs();
+        }
+        collideWalls();
+    }
+
+    double kineticEnergy() const {
+        double energy = 0.0;
+        for (int i = 0; i < size(); i++) {
+            double speed2 = static_cast<double>(vx[i]) * vx[i] + static_cast<double>(vy[i]) * vy[i] + static_cast<double>(vz[i]) * vz[i];
+            energy += 0.5 * speed2 / inverseMass[i];
+        }
+        return energy;
+    }
+
+private:
+    // queued touch of candidate pair `candidate`, or of ball -1 - candidate
+    // with wall `wall` (axis * 2, plus 1 for the high side). stamps tell if
+    // either ball has had another event since this was worked out
+    struct Event {
+        float time;
+        int candidate;
+        int wall;
+        int stampI, stampJ;
+        bool operator>(const Event& other) const {
+            return time != other.time ? time > other.time : candidate > other.candidate;
+        }
+    };
+
+    void integrate(float dt) {
+        int count = size();
+        float* px = x.data(); float* py = y.data(); float* pz = z.data();
+        const float* velocityX = vx.data(); const float* velocityY = vy.data(); const float* velocityZ = vz.data();
+        for (int i = 0; i < count; i++) {
+            px[i] += velocityX[i] * dt;
+            py[i] += velocityY[i] * dt;
+            pz[i] += velocityZ[i] * dt;
+        }
+    }
+
+    // walls are exact for any distance travelled: unfold the room into a row
+    // of mirrored copies, see which copy the ball ended up in and fold it
+    // back. every wall crossed is a bounce, an odd count flips the velocity.
+    // no clamping, a ball can not end up outside however far it went.
+    // the continuous mode bounces off the walls in sweepPairs(), this only
+    // catches what its event budget left over
+    void collideWalls() {
+        std::vector<float>* positions[3] = { &x, &y, &z };
+        std::vector<float>* velocities[3] = { &vx, &vy, &vz };
+        for (int axis = 0; axis < 3; axis++) {
+            float* p = positions[axis]->data();
+            float* v = velocities[axis]->data();
+            for (int i = 0; i < size(); i++) {
+                float low = boundsMin[axis] + radius[i], high = boundsMax[axis] - radius[i];
+                if (p[i] >= low && p[i] <= high) continue;
+                float length = std::max(high - low, 1e-6f);
+                float travelled = p[i] - low;
+                float copy = std::floor(travelled / length); // which mirrored room, 0 is the real one
+                float inPair = travelled - std::floor(travelled / (2.0f * length)) * 2.0f * length;
+                p[i] = low + (inPair > length ? 2.0f * length - inPair : inPair);
+                long long crossings = static_cast<long long>(std::fabs(copy));
+                if (crossings & 1) v[i] = -v[i];
+                wallHits += crossings;
+            }
+        }
+    }
+
+    // broad phase for both modes: every ball is wrapped in a sphere around
+    // the box its path covers this step (just the ball when dt is 0). paths
+    // that reach a wall are bounced back into the room first, which keeps
+    // the box no bigger than the straight path's.
+    // the grid's cells fit the biggest of those, and the cell ranges are tested
+    // on the pool, every range keeping its own list. the lists are joined in
+    // range order, so candidates come out the same for any thread count
+    void findCandidates(float dt) {
+        int count = size();
+        middleX.resize(count); middleY.resize(count); middleZ.resize(count);
+        reach.resize(count);
+        float maxReach = 0.0f;
+        for (int i = 0; i < count; i++) {
+            float box[3][2];
+            pathBox(x[i], vx[i], dt, boundsMin[0] + radius[i], boundsMax[0] - radius[i], box[0]);
+            pathBox(y[i], vy[i], dt, boundsMin[1] + radius[i], boundsMax[1] - radius[i], box[1]);
+            pathBox(z[i], vz[i], dt, boundsMin[2] + radius[i], boundsMax[2] - radius[i], box[2]);
+            middleX[i] = 0.5f * (box[0][0] + box[0][1]);
+            middleY[i] = 0.5f * (box[1][0] + box[1][1]);
+            middleZ[i] = 0.5f * (box[2][0] + box[2][1]);
+            float ex = box[0][1] - box[0][0], ey = box[1][1] - box[1][0], ez = box[2][1] - box[2][0];
+            reach[i] = radius[i] + 0.5f * std::sqrt(ex * ex + ey * ey + ez * ez);
+            maxReach = std::max(maxReach, reach[i]);
+        }
+        // the cells have to fit the biggest sphere. they get some headroom
+        // and are only rebuilt when that is outgrown or is more than twice
+        // what is needed, not every time the speeds change a little
+        if (maxReach > gridReach || maxReach < 0.5f * gridReach) {
+            gridReach = maxReach * GRID_HEADROOM;
+            grid.init(boundsMin[0], boundsMin[1], boundsMin[2], boundsMax[0], boundsMax[1], boundsMax[2], 2.0f * gridReach);
+        }
+        grid.build(middleX.data(), middleY.data(), middleZ.data(), count);
+
+        if (!pool) setThreads(0);
+        taskCandidates.resize(NARROW_PHASE_TASKS);
+        tested.assign(NARROW_PHASE_TASKS, 0);
+        int cellCount = grid.cellCount();
+        pool->parallelFor(NARROW_PHASE_TASKS, [&](int task) {
+            std::vector<std::pair<int, int>>& found = taskCandidates[task];
+            found.clear();
+            long long tests = 0;
+            grid.forEachPair(
+                static_cast<int>(static_cast<long long>(cellCount) * task / NARROW_PHASE_TASKS),
+                static_cast<int>(static_cast<long long>(cellCount) * (task + 1) / NARROW_PHASE_TASKS),
+                [&](int i, int j) {
+                    tests++;
+                    float dx = middleX[j] - middleX[i], dy = middleY[j] - middleY[i], dz = middleZ[j] - middleZ[i];
+                    float pairReach = reach[i] + reach[j];
+                    if (dx * dx + dy * dy + dz * dz < pairReach * pairReach) {
+                        found.emplace_back(std::min(i, j), std::max(i, j));
+                    }
+                });
+            tested[task] = tests;
+        });
+
+        candidates.clear();
+        for (int task = 0; task < NARROW_PHASE_TASKS; task++) {
+            pairTests += tested[task];
+            candidates.insert(candidates.end(), taskCandidates[task].begin(), taskCandidates[task].end());
+        }
+    }
+
+    // discrete: after the move, the candidates are the overlapping pairs
+    void collidePairs() {
+        if (size() < 2) return;
+        findCandidates(0.0f);
+        for (const auto& pair : candidates) resolve(pair.first, pair.second, false);
+    }
+
+    // the range one coordinate of a center covers moving from p at v for dt
+    // between the walls low and high: up to the wall and back to where it
+    // folds to, the whole room once it gets bounced off both. a start
+    // outside (the discrete mode before its walls) keeps the straight path
+    static void pathBox(float p, float v, float dt, float low, float high, float range[2]) {
+        float end = p + v * dt;
+        if (p < low || p > high || (end >= low && end <= high)) {
+            range[0] = std::min(p, end);
+            range[1] = std::max(p, end);
+            return;
+        }
+        float length = std::max(high - low, 0.0f);
+        if (end > high + length || end < low - length) {
+            range[0] = low;
+            range[1] = high;
+            return;
+        }
+        if (end > high) {
+            range[0] = std::min(p, 2.0f * high - end);
+            range[1] = high;
+        }
+        else {
+            range[0] = low;
+            range[1] = std::max(p, 2.0f * low - end);
+        }
+    }
+
+    // how many sweeps step() splits dt into, from the fastest ball for its size
+    int sweepPieces(float dt) const {
+        float fastest = 0.0f;
+        for (int i = 0; i < size(); i++) {
+            float speed2 = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+            fastest = std::max(fastest, std::sqrt(speed2) / radius[i]);
+        }
+        float pieces = std::ceil(fastest * dt / MAX_SWEEP_RADII);
+        return static_cast<int>(std::min(std::max(pieces, 1.0f), static_cast<float>(MAX_SWEEP_PIECES)));
+    }
+
+    // continuous: a small event simulation inside the step. ball i sits at
+    // its position at eventTime[i] and moves in a straight line from there.
+    // candidate touches and every ball's next wall go into a queue by time,
+    // the earliest is resolved, and the candidates and wall of the balls
+    // involved get their times worked out again. candidates come from the
+    // speeds at the start of the step, a ball knocked much faster can still
+    // miss a pair the broad phase never saw until the next step
+    void sweepPairs(float dt) {
+        int count = size();
+        if (count < 2) {
+            integrate(dt);
+            return;
+        }
+        findCandidates(dt);
+
+        // every ball's candidates, to reschedule them after it bounces
+        ballCandidateStart.assign(count + 1, 0);
+        for (const auto& pair : candidates) {
+            ballCandidateStart[pair.first + 1]++;
+            ballCandidateStart[pair.second + 1]++;
+        }
+        for (int i = 0; i < count; i++) ballCandidateStart[i + 1] += ballCandidateStart[i];
+        ballCandidates.resize(ballCandidateStart[count]);
+        fillPosition.assign(ballCandidateStart.begin(), ballCandidateStart.end() - 1);
+        for (int c = 0; c < static_cast<int>(candidates.size()); c++) {
+            ballCandidates[fillPosition[candidates[c].first]++] = c;
+            ballCandidates[fillPosition[candidates[c].second]++] = c;
+        }
+
+        eventTime.assign(count, 0.0f);
+        stamp.assign(count, 0);
+        events = decltype(events)();
+        for (int c = 0; c < static_cast<int>(candidates.size()); c++) schedule(c, dt);
+        for (int i = 0; i < count; i++) scheduleWall(i, dt);
+
+        // a pile of touching balls can trade tiny impulses back and forth,
+        // the cap keeps that bounded. what is left over is caught next step
+        // (collideWalls() folds back any ball it left outside)
+        long long budget = 16 * static_cast<long long>(candidates.size() + count) + 64;
+        while (!events.empty() && budget-- > 0) {
+            Event event = events.top();
+            events.pop();
+
+            if (event.candidate < 0) {
+                int i = -1 - event.candidate;
+                if (event.stampI != stamp[i]) continue;
+                advance(i, event.time);
+                bounceOffWall(i, event.wall);
+                stamp[i]++;
+                reschedule(i, dt);
+                continue;
+            }
+
+            int i = candidates[event.candidate].first, j = candidates[event.candidate].second;
+            if (event.stampI != stamp[i] || event.stampJ != stamp[j]) continue;
+
+            advance(i, event.time);
+            advance(j, event.time);
+            resolve(i, j, true);
+            stamp[i]++;
+            stamp[j]++;
+            reschedule(i, dt);
+            reschedule(j, dt);
+        }
+        for (int i = 0; i < count; i++) advance(i, dt);
+    }
+
+    void reschedule(int ball, float dt) {
+        for (int k = ballCandidateStart[ball]; k < ballCandidateStart[ball + 1]; k++) schedule(ballCandidates[k], dt);
+        scheduleWall(ball, dt);
+    }
+
+    // the first wall ball i reaches moving from its position at eventTime[i],
+    // if that is within the step. a ball already past a wall (pushed there
+    // by an overlap) and still moving out hits it straight away
+    void scheduleWall(int i, float dt) {
+        const float position[3] = { x[i], y[i], z[i] };
+        const float velocity[3] = { vx[i], vy[i], vz[i] };
+        float first = dt - eventTime[i];
+        int wall = -1;
+        for (int axis = 0; axis < 3; axis++) {
+            float s;
+            if (velocity[axis] > 0.0f) s = (boundsMax[axis] - radius[i] - position[axis]) / velocity[axis];
+            else if (velocity[axis] < 0.0f) s = (boundsMin[axis] + radius[i] - position[axis]) / velocity[axis];
+            else continue;
+            s = std::max(s, 0.0f);
+            if (s <= first) {
+                first = s;
+                wall = axis * 2 + (velocity[axis] > 0.0f ? 1 : 0);
+            }
+        }
+        if (wall < 0) return;
+        events.push({ eventTime[i] + first, -1 - i, wall, stamp[i], stamp[i] });
+    }
+
+    // puts the ball exactly against the wall and sends it back in
+    void bounceOffWall(int i, int wall) {
+        std::vector<float>* positions[3] = { &x, &y, &z };
+        std::vector<float>* velocities[3] = { &vx, &vy, &vz };
+        int axis = wall / 2;
+        float& p = (*positions[axis])[i];
+        float& v = (*velocities[axis])[i];
+        p = wall & 1 ? boundsMax[axis] - radius[i] : boundsMin[axis] + radius[i];
+        v = wall & 1 ? -std::fabs(v) : std::fabs(v);
+        wallHits++;
+    }
+
+    void advance(int i, float time) {
+        float elapsed = time - eventTime[i];
+        x[i] += vx[i] * elapsed;
+        y[i] += vy[i] * elapsed;
+        z[i] += vz[i] * elapsed;
+        eventTime[i] = time;
+    }
+
+    // earliest time in [later event time of the two, dt] at which the pair
+    // touches while moving closer: solves |d + w s|^2 = (ri + rj)^2 for the
+    // relative position d and velocity w. pairs already overlapping and
+    // still closing in touch straight away
+    void schedule(int candidate, float dt) {
+        int i = candidates[candidate].first, j = candidates[candidate].second;
+        float start = std::max(eventTime[i], eventTime[j]);
+        float ti = start - eventTime[i], tj = start - eventTime[j];
+        float dx = (x[j] + vx[j] * tj) - (x[i] + vx[i] * ti);
+        float dy = (y[j] + vy[j] * tj) - (y[i] + vy[i] * ti);
+        float dz = (z[j] + vz[j] * tj) - (z[i] + vz[i] * ti);
+        float wx = vx[j] - vx[i], wy = vy[j] - vy[i], wz = vz[j] - vz[i];
+
+        float closing = dx * wx + dy * wy + dz * wz;
+        if (closing >= 0.0f) return;
+        float pairReach = radius[i] + radius[j];
+        float gap = dx * dx + dy * dy + dz * dz - pairReach * pairReach;
+        float s = 0.0f;
+        if (gap > 0.0f) {
+            float speed2 = wx * wx + wy * wy + wz * wz;
+            float discriminant = closing * closing - speed2 * gap;
+            if (discriminant < 0.0f) return;
+            s = (-closing - std::sqrt(discriminant)) / speed2;
+        }
+        if (start + s > dt) return;
+        events.push({ start + s, candidate, -1, stamp[i], stamp[j] });
+    }
+
+    // elastic bounce along the line between the centers, then any overlap is
+    // split by mass so the pair just touches. only balls moving towards each
+    // other get the impulse, separating ones would be pulled back together.
+    // without atContact, pairs that do not overlap (any more, earlier
+    // contacts may have pushed them apart) are left alone
+    void resolve(int i, int j, bool atContact) {
+        float dx = x[j] - x[i], dy = y[j] - y[i], dz = z[j] - z[i];
+        float distance2 = dx * dx + dy * dy + dz * dz;
+        float pairReach = radius[i] + radius[j];
+        if (!atContact && distance2 >= pairReach * pairReach) return;
+        float distance = std::sqrt(distance2);
+        if (distance < 1e-6f) return; // same spot, no normal to push along
+        float nx = dx / distance, ny = dy / distance, nz = dz / distance;
+
+        float wi = inverseMass[i], wj = inverseMass[j];
+        float approach = (vx[j] - vx[i]) * nx + (vy[j] - vy[i]) * ny + (vz[j] - vz[i]) * nz;
+        if (approach < 0.0f) {
+            float impulse = -2.0f * approach / (wi + wj);
+            vx[i] -= impulse * wi * nx; vy[i] -= impulse * wi * ny; vz[i] -= impulse * wi * nz;
+            vx[j] += impulse * wj * nx; vy[j] += impulse * wj * ny; vz[j] += impulse * wj * nz;
+            ballHits++;
+        }
+
+        float overlap = std::max(0.0f, pairReach - distance) / (wi + wj);
+        x[i] -= overlap * wi * nx; y[i] -= overlap * wi * ny; z[i] -= overlap * wi * nz;
+        x[j] += overlap * wj * nx; y[j] += overlap * wj * ny; z[j] += overlap * wj * nz;
+    }
+
+    float boundsMin[3] = { 0, 0, 0 };
+    float boundsMax[3] = { 1, 1, 1 };
+
+    SpatialGrid3D grid;
+    float gridReach = 0.0f; // the grid's cells fit swept spheres up to this radius
+    std::vector<float> middleX, middleY, middleZ, reach;
+    std::vector<std::vector<std::pair<int, int>>> taskCandidates;
+    std::vector<long long> tested;
+    std::vector<std::pair<int, int>> candidates;
+
+    // continuous collision state, see sweepPairs()
+    std::vector<int> ballCandidateStart, ballCandidates, fillPosition;
+    std::vector<float> eventTime;
+    std::vector<int> stamp;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    std::unique_ptr<WorkStealingPool> pool;
+};
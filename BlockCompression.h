@@ -0,0 +1,359 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// block compression encoders for the offline texture tool. every format
+// works on 4x4 pixel blocks of rgba8 input:
+//   bc1  (dxt1) 8 bytes,  rgb, two 565 endpoints and 2 bit indices
+//   bc3  (dxt5) 16 bytes, bc1 colour plus an 8 level alpha block
+//   etc2 rgb8   8 bytes,  only the etc1 compatible individual/differential
+//                         modes, which every etc2 decoder reads the same way
+// the encoders aim for decent quality at a reasonable speed, not for the
+// best possible error
+
+enum BlockFormat {
+    BLOCK_BC1,
+    BLOCK_BC3,
+    BLOCK_ETC2_RGB,
+};
+
+inline const char* blockFormatName(BlockFormat format) {
+    switch (format) {
+    case BLOCK_BC1: return "bc1";
+    case BLOCK_BC3: return "bc3";
+    default: return "etc2";
+    }
+}
+
+// the gl enums, as stored in the ktx files
+const uint32_t GL_ENUM_COMPRESSED_RGB_S3TC_DXT1 = 0x83F0;
+const uint32_t GL_ENUM_COMPRESSED_RGBA_S3TC_DXT5 = 0x83F3;
+const uint32_t GL_ENUM_COMPRESSED_RGB8_ETC2 = 0x9274;
+
+inline uint32_t blockFormatGLEnum(BlockFormat format) {
+    switch (format) {
+    case BLOCK_BC1: return GL_ENUM_COMPRESSED_RGB_S3TC_DXT1;
+    case BLOCK_BC3: return GL_ENUM_COMPRESSED_RGBA_S3TC_DXT5;
+    default: return GL_ENUM_COMPRESSED_RGB8_ETC2;
+    }
+}
+
+inline bool blockFormatHasAlpha(BlockFormat format) {
+    return format == BLOCK_BC3;
+}
+
+inline int blockBytes(BlockFormat format) {
+    return format == BLOCK_BC3 ? 16 : 8;
+}
+
+// bytes for one level of width x height, partial blocks round up
+inline size_t compressedLevelSize(BlockFormat format, int width, int height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// copies the 4x4 block at (bx, by), clamping at the right and bottom edges
+inline void fetchBlock(const unsigned char* pixels, int width, int height, int bx, int by, unsigned char block[64]) {
+    for (int y = 0; y < 4; y++) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            memcpy(block + (y * 4 + x) * 4, pixels + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+        }
+    }
+}
+
+// ---- bc1 / bc3
+
+inline uint16_t packColor565(float r, float g, float b) {
+    int r5 = std::min(31, std::max(0, static_cast<int>(r * 31.0f / 255.0f + 0.5f)));
+    int g6 = std::min(63, std::max(0, static_cast<int>(g * 63.0f / 255.0f + 0.5f)));
+    int b5 = std::min(31, std::max(0, static_cast<int>(b * 31.0f / 255.0f + 0.5f)));
+    return static_cast<uint16_t>((r5 << 11) | (g6 << 5) | b5);
+}
+
+inline void unpackColor565(uint16_t color, int rgb[3]) {
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// endpoints along the principal axis of the block's colours, then every
+// pixel takes the nearest of the 4 palette entries. always 4 colour mode
+inline void encodeBC1Block(const unsigned char block[64], unsigned char out[8]) {
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) mean[c] += block[i * 4 + c];
+    }
+    for (int c = 0; c < 3; c++) mean[c] /= 16.0f;
+
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++) {
+        float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+        covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+        covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+    }
+
+    // a few power iterations are plenty for a 3x3 matrix
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (length < 1e-6f) break;
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+
+    float lowest = 1e30f, highest = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+        lowest = std::min(lowest, t);
+        highest = std::max(highest, t);
+    }
+    float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    if (axisLength2 > 0.0f) {
+        lowest /= axisLength2;
+        highest /= axisLength2;
+    }
+
+    uint16_t color0 = packColor565(mean[0] + axis[0] * highest, mean[1] + axis[1] * highest, mean[2] + axis[2] * highest);
+    uint16_t color1 = packColor565(mean[0] + axis[0] * lowest, mean[1] + axis[1] * lowest, mean[2] + axis[2] * lowest);
+    if (color0 < color1) std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpackColor565(color0, palette[0]);
+        unpackColor565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dr = block[i * 4] - palette[p][0], dg = block[i * 4 + 1] - palette[p][1], db = block[i * 4 + 2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+    }
+
+    out[0] = color0 & 0xFF; out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF; out[3] = color1 >> 8;
+    for (int i = 0; i < 4; i++) out[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+// bc3 alpha: the block's min and max as endpoints in 8 level mode
+inline void encodeBC3AlphaBlock(const unsigned char block[64], unsigned char out[8]) {
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; i++) {
+        alpha0 = std::max(alpha0, static_cast<int>(block[i * 4 + 3]));
+        alpha1 = std::min(alpha1, static_cast<int>(block[i * 4 + 3]));
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 > alpha1) {
+        int palette[8] = { alpha0, alpha1 };
+        for (int p = 1; p < 7; p++) {
+            palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 8; p++) {
+                int error = std::abs(block[i * 4 + 3] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (i * 3);
+        }
+    }
+
+    out[0] = static_cast<unsigned char>(alpha0);
+    out[1] = static_cast<unsigned char>(alpha1);
+    for (int i = 0; i < 6; i++) out[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+inline void encodeBC3Block(const unsigned char block[64], unsigned char out[16]) {
+    encodeBC3AlphaBlock(block, out);
+    encodeBC1Block(block, out + 8);
+}
+
+// ---- etc1 subset of etc2 rgb8
+
+const int ETC_MODIFIERS[8][2] = {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+// pixel index values 0..3 map to +small, +large, -small, -large
+inline int etcModifier(int table, int index) {
+    int value = ETC_MODIFIERS[table][index & 1];
+    return index & 2 ? -value : value;
+}
+
+inline int clampByte(int value) {
+    return std::min(255, std::max(0, value));
+}
+
+// best table and per pixel indices for one half block around a base colour.
+// pixels are the block indices (y * 4 + x) in this half
+inline int fitEtcSubblock(const unsigned char block[64], const int* pixels, const int base[3], int& bestTable, int indices[8]) {
+    int bestError = 1 << 30;
+    for (int table = 0; table < 8; table++) {
+        int error = 0;
+        int tableIndices[8];
+        for (int i = 0; i < 8; i++) {
+            const unsigned char* pixel = block + pixels[i] * 4;
+            int pixelBest = 0, pixelError = 1 << 30;
+            for (int index = 0; index < 4; index++) {
+                int modifier = etcModifier(table, index);
+                int dr = pixel[0] - clampByte(base[0] + modifier);
+                int dg = pixel[1] - clampByte(base[1] + modifier);
+                int db = pixel[2] - clampByte(base[2] + modifier);
+                int e = dr * dr + dg * dg + db * db;
+                if (e < pixelError) {
+                    pixelError = e;
+                    pixelBest = index;
+                }
+            }
+            tableIndices[i] = pixelBest;
+            error += pixelError;
+        }
+        if (error < bestError) {
+            bestError = error;
+            bestTable = table;
+            memcpy(indices, tableIndices, sizeof(tableIndices));
+        }
+    }
+    return bestError;
+}
+
+// one candidate encoding (a split direction) with its error
+inline int encodeEtcSplit(const unsigned char block[64], bool flip, uint64_t& bits) {
+    // flip 0 splits left/right (2x4 halves), flip 1 top/bottom (4x2 halves)
+    int halves[2][8];
+    for (int half = 0; half < 2; half++) {
+        int n = 0;
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                int side = flip ? (y >= 2) : (x >= 2);
+                if (side == half) halves[half][n++] = y * 4 + x;
+            }
+        }
+    }
+
+    float average[2][3];
+    for (int half = 0; half < 2; half++) {
+        for (int c = 0; c < 3; c++) {
+            int sum = 0;
+            for (int i = 0; i < 8; i++) sum += block[halves[half][i] * 4 + c];
+            average[half][c] = sum / 8.0f;
+        }
+    }
+
+    // differential mode when the second 555 colour is within -4..3 of the first
+    int base5[2][3];
+    bool differential = true;
+    for (int half = 0; half < 2; half++) {
+        for (int c = 0; c < 3; c++) {
+            base5[half][c] = std::min(31, std::max(0, static_cast<int>(average[half][c] * 31.0f / 255.0f + 0.5f)));
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        int delta = base5[1][c] - base5[0][c];
+        if (delta < -4 || delta > 3) differential = false;
+    }
+
+    int base[2][3];
+    int stored[2][3];
+    for (int half = 0; half < 2; half++) {
+        for (int c = 0; c < 3; c++) {
+            if (differential) {
+                stored[half][c] = base5[half][c];
+                base[half][c] = (base5[half][c] << 3) | (base5[half][c] >> 2);
+            }
+            else {
+                int value4 = std::min(15, std::max(0, static_cast<int>(average[half][c] * 15.0f / 255.0f + 0.5f)));
+                stored[half][c] = value4;
+                base[half][c] = (value4 << 4) | value4;
+            }
+        }
+    }
+
+    int tables[2] = { 0, 0 };
+    int indices[2][8];
+    int error = fitEtcSubblock(block, halves[0], base[0], tables[0], indices[0]) +
+        fitEtcSubblock(block, halves[1], base[1], tables[1], indices[1]);
+
+    // high word: colours, tables, diff and flip bits. low word: index bits,
+    // msb plane in bits 16..31 and lsb plane in 0..15, pixel i = x * 4 + y
+    uint32_t high = 0;
+    for (int c = 0; c < 3; c++) {
+        uint32_t first, second;
+        if (differential) {
+            first = stored[0][c] << 3;
+            second = static_cast<uint32_t>(stored[1][c] - stored[0][c]) & 7;
+        }
+        else {
+            first = stored[0][c] << 4;
+            second = stored[1][c];
+        }
+        high |= (first | second) << (24 - c * 8);
+    }
+    high |= tables[0] << 5;
+    high |= tables[1] << 2;
+    high |= (differential ? 1u : 0u) << 1;
+    high |= flip ? 1u : 0u;
+
+    uint32_t low = 0;
+    for (int half = 0; half < 2; half++) {
+        for (int i = 0; i < 8; i++) {
+            int pixel = halves[half][i];
+            int x = pixel % 4, y = pixel / 4;
+            int bit = x * 4 + y;
+            int index = indices[half][i];
+            low |= static_cast<uint32_t>((index >> 1) & 1) << (bit + 16);
+            low |= static_cast<uint32_t>(index & 1) << bit;
+        }
+    }
+
+    bits = (static_cast<uint64_t>(high) << 32) | low;
+    return error;
+}
+
+inline void encodeETC2Block(const unsigned char block[64], unsigned char out[8]) {
+    uint64_t bits0, bits1;
+    int error0 = encodeEtcSplit(block, false, bits0);
+    int error1 = encodeEtcSplit(block, true, bits1);
+    uint64_t bits = error0 <= error1 ? bits0 : bits1;
+    for (int i = 0; i < 8; i++) {
+        out[i] = static_cast<unsigned char>(bits >> (56 - i * 8)); // big endian
+    }
+}
+
+// compresses one rgba8 level, blocks in row order
+inline void compressLevel(BlockFormat format, const unsigned char* pixels, int width, int height, unsigned char* out) {
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    unsigned char block[64];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            fetchBlock(pixels, width, height, bx, by, block);
+            switch (format) {
+            case BLOCK_BC1: encodeBC1Block(block, out); break;
+            case BLOCK_BC3: encodeBC3Block(block, out); break;
+            default: encodeETC2Block(block, out); break;
+            }
+            out += blockBytes(format);
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cmath>
+
+// sphere vs many spheres, with the spheres stored as separate x/y/z/radius
+// arrays. compares squared distances so there is no sqrt anywhere, and does
+// 8 (avx2) or 4 (sse2) spheres per step with a scalar loop for the rest
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define COLLISION_SWEEP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COLLISION_SWEEP_SSE2
+#endif
+
+inline const char* collisionSweepName() {
+#if defined(COLLISION_SWEEP_AVX2)
+    return "avx2";
+#elif defined(COLLISION_SWEEP_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+// the plain loop, also used for the leftovers of the simd versions
+inline int sweepSpheresScalar(const float* x, const float* y, const float* z, const float* radius,
+    int begin, int end, float px, float py, float pz, float pr) {
+    for (int i = begin; i < end; i++) {
+        float dx = px - x[i];
+        float dy = py - y[i];
+        float dz = pz - z[i];
+        float reach = pr + radius[i];
+        if (dx * dx + dy * dy + dz * dz < reach * reach) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// index of the first sphere overlapping (px, py, pz, pr), -1 if none
+inline int sweepSpheres(const float* x, const float* y, const float* z, const float* radius,
+    int count, float px, float py, float pz, float pr) {
+    int i = 0;
+
+#if defined(COLLISION_SWEEP_AVX2)
+    const __m256 probeX = _mm256_set1_ps(px);
+    const __m256 probeY = _mm256_set1_ps(py);
+    const __m256 probeZ = _mm256_set1_ps(pz);
+    const __m256 probeR = _mm256_set1_ps(pr);
+    for (; i + 8 <= count; i += 8) {
+        __m256 dx = _mm256_sub_ps(probeX, _mm256_loadu_ps(x + i));
+        __m256 dy = _mm256_sub_ps(probeY, _mm256_loadu_ps(y + i));
+        __m256 dz = _mm256_sub_ps(probeZ, _mm256_loadu_ps(z + i));
+        __m256 reach = _mm256_add_ps(probeR, _mm256_loadu_ps(radius + i));
+        __m256 distance2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        int hits = _mm256_movemask_ps(_mm256_cmp_ps(distance2, _mm256_mul_ps(reach, reach), _CMP_LT_OQ));
+        if (hits) {
+            for (int lane = 0; lane < 8; lane++) {
+                if (hits & (1 << lane)) return i + lane;
+            }
+        }
+    }
+#elif defined(COLLISION_SWEEP_SSE2)
+    const __m128 probeX = _mm_set1_ps(px);
+    const __m128 probeY = _mm_set1_ps(py);
+    const __m128 probeZ = _mm_set1_ps(pz);
+    const __m128 probeR = _mm_set1_ps(pr);
+    for (; i + 4 <= count; i += 4) {
+        __m128 dx = _mm_sub_ps(probeX, _mm_loadu_ps(x + i));
+        __m128 dy = _mm_sub_ps(probeY, _mm_loadu_ps(y + i));
+        __m128 dz = _mm_sub_ps(probeZ, _mm_loadu_ps(z + i));
+        __m128 reach = _mm_add_ps(probeR, _mm_loadu_ps(radius + i));
+        __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        int hits = _mm_movemask_ps(_mm_cmplt_ps(distance2, _mm_mul_ps(reach, reach)));
+        if (hits) {
+            for (int lane = 0; lane < 4; lane++) {
+                if (hits & (1 << lane)) return i + lane;
+            }
+        }
+    }
+#endif
+
+    return sweepSpheresScalar(x, y, z, radius, i, count, px, py, pz, pr);
+}
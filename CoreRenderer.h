@@ -0,0 +1,383 @@
+#pragma once
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "Frustum.h"
+#include "GLExtensions.h"
+#include "MeshCache.h"
+#include "Shaders.h"
+
+// gl 3.3 core profile renderer: no glLight/glMaterial, no matrix stack and
+// no glBegin, so the driver has no fixed function pipeline to emulate.
+// lighting is the fixed function equation for one light (global ambient,
+// light ambient, lambert diffuse, blinn specular with the viewer at
+// infinity, texture modulating the result) evaluated per pixel instead of
+// per vertex. per frame values (projection, light) and per object values
+// (modelview, material) live in two uniform buffers, the object one is a
+// ring that is written forward and orphaned when it wraps, so a draw never
+// waits for the gpu to finish reading an earlier object
+
+// column major like glLoadMatrixf, m[12..14] is the translation
+struct Mat4 {
+    float m[16];
+};
+
+inline Mat4 identityMatrix() {
+    Mat4 result = {};
+    result.m[0] = result.m[5] = result.m[10] = result.m[15] = 1.0f;
+    return result;
+}
+
+// a * b, so b is applied first like glMultMatrixf
+inline Mat4 multiply(const Mat4& a, const Mat4& b) {
+    Mat4 result;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+            result.m[column * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+inline Mat4 translationMatrix(float x, float y, float z) {
+    Mat4 result = identityMatrix();
+    result.m[12] = x; result.m[13] = y; result.m[14] = z;
+    return result;
+}
+
+inline Mat4 scaleMatrix(float scale) {
+    Mat4 result = identityMatrix();
+    result.m[0] = result.m[5] = result.m[10] = scale;
+    return result;
+}
+
+// same as glRotatef
+inline Mat4 rotationMatrix(float degrees, float x, float y, float z) {
+    float axis[3] = { x, y, z };
+    normalize3(axis);
+    float c = std::cos(degrees * MESH_PI / 180.0f), s = std::sin(degrees * MESH_PI / 180.0f);
+    x = axis[0]; y = axis[1]; z = axis[2];
+
+    Mat4 result = identityMatrix();
+    result.m[0] = x * x * (1 - c) + c;     result.m[4] = x * y * (1 - c) - z * s; result.m[8] = x * z * (1 - c) + y * s;
+    result.m[1] = y * x * (1 - c) + z * s; result.m[5] = y * y * (1 - c) + c;     result.m[9] = y * z * (1 - c) - x * s;
+    result.m[2] = x * z * (1 - c) - y * s; result.m[6] = y * z * (1 - c) + x * s; result.m[10] = z * z * (1 - c) + c;
+    return result;
+}
+
+// same as gluPerspective
+inline Mat4 perspectiveMatrix(float fovY, float aspect, float zNear, float zFar) {
+    float f = 1.0f / std::tan(fovY * 0.5f * MESH_PI / 180.0f);
+    Mat4 result = {};
+    result.m[0] = f / aspect;
+    result.m[5] = f;
+    result.m[10] = (zFar + zNear) / (zNear - zFar);
+    result.m[11] = -1.0f;
+    result.m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+    return result;
+}
+
+// same as gluLookAt
+inline Mat4 lookAtMatrix(const float eye[3], const float center[3], const float up[3]) {
+    float forward[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    normalize3(forward);
+    float side[3], cameraUp[3];
+    cross3(forward, up, side);
+    normalize3(side);
+    cross3(side, forward, cameraUp);
+
+    Mat4 result = identityMatrix();
+    for (int k = 0; k < 3; k++) {
+        result.m[k * 4 + 0] = side[k];
+        result.m[k * 4 + 1] = cameraUp[k];
+        result.m[k * 4 + 2] = -forward[k];
+    }
+    return multiply(result, translationMatrix(-eye[0], -eye[1], -eye[2]));
+}
+
+struct CoreMaterial {
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+    float shininess;
+};
+
+// the fixed function defaults
+const CoreMaterial DEFAULT_MATERIAL = {
+    { 0.2f, 0.2f, 0.2f, 1.0f }, { 0.8f, 0.8f, 0.8f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.0f,
+};
+
+// position in eye space (glLightfv under an identity modelview), w 0 for a
+// directional light
+struct CoreLight {
+    float position[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+};
+
+// binding points of the two uniform blocks
+const GLuint FRAME_BLOCK_BINDING = 0;
+const GLuint OBJECT_BLOCK_BINDING = 1;
+
+// goes in front of every core shader: the two blocks (std140, laid out
+// like FrameBlock and ObjectBlock below) and the lighting function
+const char* const CORE_SHADER_HEADER = R"(#version 330 core
+layout(std140) uniform Frame {
+    mat4 projection;
+    vec4 lightPosition;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+    vec4 sceneAmbient;
+};
+
+layout(std140) uniform Object {
+    mat4 modelView;
+    vec4 materialAmbient;
+    vec4 materialDiffuse;
+    vec4 materialSpecular;
+    float shininess;
+    int useTexture;
+};
+
+// glLightModel ambient, glLight and glMaterial combined the way the fixed
+// function pipeline does for light 0, position and normal in eye space
+vec4 phong(vec3 position, vec3 normal) {
+    vec3 light = lightPosition.w == 0.0 ? normalize(lightPosition.xyz) : normalize(lightPosition.xyz - position);
+    float diffuse = max(dot(normal, light), 0.0);
+    vec4 color = sceneAmbient * materialAmbient + lightAmbient * materialAmbient + diffuse * lightDiffuse * materialDiffuse;
+    if (diffuse > 0.0) {
+        vec3 halfVector = normalize(light + vec3(0.0, 0.0, 1.0));
+        color += pow(max(dot(normal, halfVector), 1e-6), shininess) * lightSpecular * materialSpecular;
+    }
+    return vec4(clamp(color.rgb, 0.0, 1.0), materialDiffuse.a);
+}
+)";
+
+const char* const PHONG_VERTEX_SHADER = R"(
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+out vec3 eyePosition;
+out vec3 eyeNormal;
+out vec2 surfaceTexCoord;
+
+void main() {
+    vec4 eye = modelView * vec4(position, 1.0);
+    eyePosition = eye.xyz;
+    // uniform scales only, the fragment shader normalizes
+    eyeNormal = mat3(modelView) * normal;
+    surfaceTexCoord = texCoord;
+    gl_Position = projection * eye;
+}
+)";
+
+// many copies of one mesh in a single draw, each moved and uniformly scaled
+// by a per instance x y z scale record, modelView goes on top of that
+const GLuint INSTANCE_OFFSET_SCALE_ATTRIB = 3;
+const int INSTANCE_OFFSET_SCALE_FLOATS = 4;
+
+const char* const PHONG_INSTANCED_VERTEX_SHADER = R"(
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+layout(location = 3) in vec4 instanceOffsetScale;
+out vec3 eyePosition;
+out vec3 eyeNormal;
+out vec2 surfaceTexCoord;
+
+void main() {
+    vec4 eye = modelView * vec4(position * instanceOffsetScale.w + instanceOffsetScale.xyz, 1.0);
+    eyePosition = eye.xyz;
+    eyeNormal = mat3(modelView) * normal;
+    surfaceTexCoord = texCoord;
+    gl_Position = projection * eye;
+}
+)";
+
+const char* const PHONG_FRAGMENT_SHADER = R"(
+uniform sampler2D image;
+in vec3 eyePosition;
+in vec3 eyeNormal;
+in vec2 surfaceTexCoord;
+out vec4 fragColor;
+
+void main() {
+    vec4 color = phong(eyePosition, normalize(eyeNormal));
+    fragColor = useTexture != 0 ? color * texture(image, surfaceTexCoord) : color;
+}
+)";
+
+class CoreRenderer {
+public:
+    static const size_t OBJECT_RING_BYTES = 1 << 20;
+
+    // needs loadGLExtensions() in a 3.3 core context, false if that is missing
+    bool init() {
+        if (!glext.hasCoreRendering) {
+            std::cout << "Failed to start the core renderer, it needs an OpenGL 3.3 core profile context" << std::endl;
+            return false;
+        }
+
+        phong = buildProgram(PHONG_VERTEX_SHADER, PHONG_FRAGMENT_SHADER);
+        phongInstanced = buildProgram(PHONG_INSTANCED_VERTEX_SHADER, PHONG_FRAGMENT_SHADER);
+        if (!phong || !phongInstanced) return false;
+
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        objectStride = (sizeof(ObjectBlock) + alignment - 1) / alignment * alignment;
+
+        glext.genBuffers(1, &frameBuffer);
+        glext.bindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+        glext.bufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), nullptr, GL_STREAM_DRAW);
+        glext.genBuffers(1, &objectBuffer);
+        glext.bindBuffer(GL_UNIFORM_BUFFER, objectBuffer);
+        glext.bufferData(GL_UNIFORM_BUFFER, OBJECT_RING_BYTES, nullptr, GL_STREAM_DRAW);
+        glext.bindBuffer(GL_UNIFORM_BUFFER, 0);
+        glext.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameBuffer, 0, sizeof(FrameBlock));
+        return true;
+    }
+
+    // CORE_SHADER_HEADER goes in front of both, attribute locations come
+    // from layout qualifiers
+    GLuint buildProgram(const char* vertexSource, const char* fragmentSource) {
+        std::string vertex = std::string(CORE_SHADER_HEADER) + vertexSource;
+        std::string fragment = std::string(CORE_SHADER_HEADER) + fragmentSource;
+        GLuint program = buildShaderProgram(vertex.c_str(), fragment.c_str());
+        if (!program) return 0;
+
+        GLuint frameIndex = glext.getUniformBlockIndex(program, "Frame");
+        GLuint objectIndex = glext.getUniformBlockIndex(program, "Object");
+        if (frameIndex != GL_INVALID_INDEX) glext.uniformBlockBinding(program, frameIndex, FRAME_BLOCK_BINDING);
+        if (objectIndex != GL_INVALID_INDEX) glext.uniformBlockBinding(program, objectIndex, OBJECT_BLOCK_BINDING);
+        return program;
+    }
+
+    // the projection and light for everything drawn until the next call
+    void beginFrame(const Mat4& projection, const CoreLight& light, const float sceneAmbient[4]) {
+        FrameBlock frame;
+        memcpy(frame.projection, projection.m, sizeof(frame.projection));
+        memcpy(frame.lightPosition, light.position, sizeof(frame.lightPosition));
+        memcpy(frame.lightAmbient, light.ambient, sizeof(frame.lightAmbient));
+        memcpy(frame.lightDiffuse, light.diffuse, sizeof(frame.lightDiffuse));
+        memcpy(frame.lightSpecular, light.specular, sizeof(frame.lightSpecular));
+        memcpy(frame.sceneAmbient, sceneAmbient, sizeof(frame.sceneAmbient));
+        glext.bindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+        glext.bufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), &frame, GL_STREAM_DRAW);
+        glext.bindBuffer(GL_UNIFORM_BUFFER, 0);
+        // other code may have changed these since the last frame
+        boundProgram = 0;
+        boundVertexArray = 0;
+    }
+
+    // fills the next object slot and binds it for the following draws.
+    // texture 0 draws untextured
+    void setObject(const Mat4& modelView, const CoreMaterial& material, GLuint texture) {
+        ObjectBlock object = {};
+        memcpy(object.modelView, modelView.m, sizeof(object.modelView));
+        memcpy(object.ambient, material.ambient, sizeof(object.ambient));
+        memcpy(object.diffuse, material.diffuse, sizeof(object.diffuse));
+        memcpy(object.specular, material.specular, sizeof(object.specular));
+        object.shininess = material.shininess;
+        object.useTexture = texture ? 1 : 0;
+
+        glext.bindBuffer(GL_UNIFORM_BUFFER, objectBuffer);
+        if (objectOffset + objectStride > OBJECT_RING_BYTES) {
+            glext.bufferData(GL_UNIFORM_BUFFER, OBJECT_RING_BYTES, nullptr, GL_STREAM_DRAW);
+            objectOffset = 0;
+        }
+        // the slot has not been used since the last orphaning, so there is
+        // nothing to wait for. glBufferSubData would not know that and
+        // llvmpipe finishes the frame so far before every write
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+        void* slot = glext.mapBufferRange(GL_UNIFORM_BUFFER, objectOffset, sizeof(ObjectBlock), access);
+        if (slot) {
+            memcpy(slot, &object, sizeof(ObjectBlock));
+            glext.unmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        glext.bindBuffer(GL_UNIFORM_BUFFER, 0);
+        glext.bindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, objectBuffer, objectOffset, sizeof(ObjectBlock));
+        objectOffset += objectStride;
+        objects++;
+
+        if (texture) glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    void useProgram(GLuint program) {
+        if (program == boundProgram) return;
+        glext.useProgram(program);
+        boundProgram = program;
+    }
+
+    void bindVertexArray(GLuint vertexArray) {
+        if (vertexArray == boundVertexArray) return;
+        glext.bindVertexArray(vertexArray);
+        boundVertexArray = vertexArray;
+    }
+
+    // an uploaded mesh (uploadMesh) with the phong program
+    void drawMesh(const Mesh& mesh, const Mat4& modelView, const CoreMaterial& material, GLuint texture) {
+        setObject(modelView, material, texture);
+        useProgram(phong);
+        bindVertexArray(mesh.vao);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, nullptr);
+    }
+
+    // count instances whose records start firstInstance records into
+    // instanceBuffer. the instance attribute stays set up on the mesh's
+    // vertex array, the plain phong program does not read it
+    void drawMeshInstanced(const Mesh& mesh, GLuint instanceBuffer, int firstInstance, int count,
+        const Mat4& modelView, const CoreMaterial& material, GLuint texture) {
+        if (count <= 0) return;
+        setObject(modelView, material, texture);
+        useProgram(phongInstanced);
+        bindVertexArray(mesh.vao);
+
+        const GLsizei stride = INSTANCE_OFFSET_SCALE_FLOATS * sizeof(float);
+        glext.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glext.vertexAttribPointer(INSTANCE_OFFSET_SCALE_ATTRIB, 4, GL_FLOAT, GL_FALSE, stride,
+            reinterpret_cast<const void*>(static_cast<size_t>(firstInstance) * stride));
+        glext.enableVertexAttribArray(INSTANCE_OFFSET_SCALE_ATTRIB);
+        glext.vertexAttribDivisor(INSTANCE_OFFSET_SCALE_ATTRIB, 1);
+        glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glext.drawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, nullptr, count);
+    }
+
+    GLuint phongProgram() const { return phong; }
+
+    long long objects = 0; // object blocks written, for stats
+
+private:
+    // std140 layouts of the Frame and Object blocks
+    struct FrameBlock {
+        float projection[16];
+        float lightPosition[4];
+        float lightAmbient[4];
+        float lightDiffuse[4];
+        float lightSpecular[4];
+        float sceneAmbient[4];
+    };
+    struct ObjectBlock {
+        float modelView[16];
+        float ambient[4];
+        float diffuse[4];
+        float specular[4];
+        float shininess;
+        int useTexture;
+        float padding[2];
+    };
+
+    GLuint phong = 0;
+    GLuint phongInstanced = 0;
+    GLuint frameBuffer = 0;
+    GLuint objectBuffer = 0;
+    size_t objectStride = sizeof(ObjectBlock);
+    size_t objectOffset = 0;
+    GLuint boundProgram = 0;
+    GLuint boundVertexArray = 0;
+};
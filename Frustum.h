@@ -0,0 +1,146 @@
+#pragma once
+#include <cmath>
+
+// view frustum culling for spheres. the six planes come from the same
+// numbers that go into gluPerspective and gluLookAt, in world space, with
+// normals pointing inwards and unit length, so plane(center) is the signed
+// distance. a sphere is culled when it is entirely behind any plane (the
+// usual conservative test: near the corners a sphere can pass that is not
+// really visible, but nothing visible is ever culled).
+// cullSpheres() takes separate x/y/z/radius arrays and does 8 (avx2) or 4
+// (sse2) spheres per step against all six planes, scalar for the rest
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FRUSTUM_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_SSE2
+#endif
+
+inline const char* frustumCullName() {
+#if defined(FRUSTUM_AVX2)
+    return "avx2";
+#elif defined(FRUSTUM_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+struct Frustum {
+    // a x + b y + c z + d >= 0 inside: near, far, left, right, bottom, top
+    float planes[6][4];
+};
+
+inline void normalize3(float v[3]) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length; v[1] /= length; v[2] /= length;
+    }
+}
+
+inline void cross3(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// fovY in degrees and aspect as in gluPerspective, eye/center/up as in gluLookAt
+inline Frustum makeFrustum(const float eye[3], const float center[3], const float up[3],
+    float fovY, float aspect, float zNear, float zFar) {
+    float forward[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    normalize3(forward);
+    float side[3], cameraUp[3];
+    cross3(forward, up, side);
+    normalize3(side);
+    cross3(side, forward, cameraUp);
+
+    float tanY = std::tan(fovY * 0.5f * 3.14159265f / 180.0f);
+    float tanX = tanY * aspect;
+
+    // the side planes go through the eye: a point is inside the right plane
+    // when its sideways offset is at most tanX times its distance ahead
+    float normals[6][3];
+    for (int k = 0; k < 3; k++) {
+        normals[0][k] = forward[k];
+        normals[1][k] = -forward[k];
+        normals[2][k] = forward[k] * tanX + side[k];
+        normals[3][k] = forward[k] * tanX - side[k];
+        normals[4][k] = forward[k] * tanY + cameraUp[k];
+        normals[5][k] = forward[k] * tanY - cameraUp[k];
+    }
+
+    Frustum frustum;
+    for (int p = 0; p < 6; p++) {
+        normalize3(normals[p]);
+        float* plane = frustum.planes[p];
+        plane[0] = normals[p][0];
+        plane[1] = normals[p][1];
+        plane[2] = normals[p][2];
+        plane[3] = -(plane[0] * eye[0] + plane[1] * eye[1] + plane[2] * eye[2]);
+    }
+    frustum.planes[0][3] -= zNear;
+    frustum.planes[1][3] += zFar;
+    return frustum;
+}
+
+inline bool sphereInFrustum(const Frustum& frustum, float x, float y, float z, float radius) {
+    for (const auto& plane : frustum.planes) {
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < -radius) return false;
+    }
+    return true;
+}
+
+// visible[i] = 1 if sphere i may be on screen, 0 if not. returns how many are visible
+inline int cullSpheres(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+    int count, unsigned char* visible) {
+    int i = 0;
+    int inside = 0;
+
+#if defined(FRUSTUM_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+        __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+        __m256 keep = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const auto& plane : frustum.planes) {
+            __m256 distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), px), _mm256_mul_ps(_mm256_set1_ps(plane[1]), py)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[2]), pz), _mm256_set1_ps(plane[3])));
+            keep = _mm256_and_ps(keep, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+        }
+        int mask = _mm256_movemask_ps(keep);
+        for (int lane = 0; lane < 8; lane++) {
+            visible[i + lane] = (mask >> lane) & 1;
+            inside += (mask >> lane) & 1;
+        }
+    }
+#elif defined(FRUSTUM_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+        __m128 keep = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const auto& plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), px), _mm_mul_ps(_mm_set1_ps(plane[1]), py)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[2]), pz), _mm_set1_ps(plane[3])));
+            keep = _mm_and_ps(keep, _mm_cmpge_ps(distance, negativeRadius));
+        }
+        int mask = _mm_movemask_ps(keep);
+        for (int lane = 0; lane < 4; lane++) {
+            visible[i + lane] = (mask >> lane) & 1;
+            inside += (mask >> lane) & 1;
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        visible[i] = sphereInFrustum(frustum, x[i], y[i], z[i], radius[i]) ? 1 : 0;
+        inside += visible[i];
+    }
+    return inside;
+}
@@ -0,0 +1,317 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <GL/glut.h>
+#include <GL/freeglut_ext.h>
+
+// windows only ships gl 1.1 headers, so anything newer (buffers etc.) is
+// loaded at runtime through glutGetProcAddress and checked before use
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STREAM_DRAW 0x88E0
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+
+#ifndef GL_WRITE_ONLY
+#define GL_WRITE_ONLY 0x88B9
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_WAIT_FAILED 0x911D
+#endif
+
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT 0x8A34
+#define GL_INVALID_INDEX 0xFFFFFFFFu
+#endif
+
+#ifndef GL_NUM_EXTENSIONS
+#define GL_NUM_EXTENSIONS 0x821D
+#endif
+
+#ifndef GL_CONTEXT_PROFILE_MASK
+#define GL_CONTEXT_PROFILE_MASK 0x9126
+#define GL_CONTEXT_CORE_PROFILE_BIT 0x00000001
+#endif
+
+#ifndef GL_VERTEX_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+
+typedef void (APIENTRY* GenBuffersFn)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY* DeleteBuffersFn)(GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY* BindBufferFn)(GLenum target, GLuint buffer);
+typedef void (APIENTRY* BufferDataFn)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef void (APIENTRY* BufferSubDataFn)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void* data);
+typedef void* (APIENTRY* MapBufferFn)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY* UnmapBufferFn)(GLenum target);
+
+// GLsync is a pointer, kept as void* so this works with the gl 1.1 headers
+typedef void* SyncHandle;
+typedef void (APIENTRY* BufferStorageFn)(GLenum target, ptrdiff_t size, const void* data, GLbitfield flags);
+typedef void* (APIENTRY* MapBufferRangeFn)(GLenum target, ptrdiff_t offset, ptrdiff_t length, GLbitfield access);
+typedef SyncHandle (APIENTRY* FenceSyncFn)(GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRY* ClientWaitSyncFn)(SyncHandle sync, GLbitfield flags, unsigned long long timeout);
+typedef void (APIENTRY* DeleteSyncFn)(SyncHandle sync);
+
+typedef GLuint (APIENTRY* CreateShaderFn)(GLenum type);
+typedef void (APIENTRY* DeleteShaderFn)(GLuint shader);
+typedef void (APIENTRY* ShaderSourceFn)(GLuint shader, GLsizei count, const char* const* source, const GLint* length);
+typedef void (APIENTRY* CompileShaderFn)(GLuint shader);
+typedef void (APIENTRY* GetShaderivFn)(GLuint shader, GLenum name, GLint* params);
+typedef void (APIENTRY* GetShaderInfoLogFn)(GLuint shader, GLsizei size, GLsizei* length, char* log);
+typedef GLuint (APIENTRY* CreateProgramFn)();
+typedef void (APIENTRY* DeleteProgramFn)(GLuint program);
+typedef void (APIENTRY* AttachShaderFn)(GLuint program, GLuint shader);
+typedef void (APIENTRY* BindAttribLocationFn)(GLuint program, GLuint index, const char* name);
+typedef void (APIENTRY* LinkProgramFn)(GLuint program);
+typedef void (APIENTRY* GetProgramivFn)(GLuint program, GLenum name, GLint* params);
+typedef void (APIENTRY* GetProgramInfoLogFn)(GLuint program, GLsizei size, GLsizei* length, char* log);
+typedef void (APIENTRY* UseProgramFn)(GLuint program);
+typedef GLint (APIENTRY* GetUniformLocationFn)(GLuint program, const char* name);
+typedef void (APIENTRY* Uniform1iFn)(GLint location, GLint value);
+typedef void (APIENTRY* Uniform1fFn)(GLint location, GLfloat value);
+typedef void (APIENTRY* EnableVertexAttribArrayFn)(GLuint index);
+typedef void (APIENTRY* DisableVertexAttribArrayFn)(GLuint index);
+typedef void (APIENTRY* VertexAttribPointerFn)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+
+typedef void (APIENTRY* CompressedTexImage2DFn)(GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height, GLint border, GLsizei size, const void* data);
+
+typedef void (APIENTRY* VertexAttribDivisorFn)(GLuint index, GLuint divisor);
+typedef void (APIENTRY* DrawElementsInstancedFn)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances);
+
+typedef void (APIENTRY* GenVertexArraysFn)(GLsizei n, GLuint* arrays);
+typedef void (APIENTRY* DeleteVertexArraysFn)(GLsizei n, const GLuint* arrays);
+typedef void (APIENTRY* BindVertexArrayFn)(GLuint array);
+typedef GLuint (APIENTRY* GetUniformBlockIndexFn)(GLuint program, const char* name);
+typedef void (APIENTRY* UniformBlockBindingFn)(GLuint program, GLuint blockIndex, GLuint binding);
+typedef void (APIENTRY* BindBufferRangeFn)(GLenum target, GLuint index, GLuint buffer, ptrdiff_t offset, ptrdiff_t size);
+typedef const GLubyte* (APIENTRY* GetStringiFn)(GLenum name, GLuint index);
+
+struct GLExtensions {
+    // gl 1.5 buffer objects
+    bool hasBuffers = false;
+    GenBuffersFn genBuffers = nullptr;
+    DeleteBuffersFn deleteBuffers = nullptr;
+    BindBufferFn bindBuffer = nullptr;
+    BufferDataFn bufferData = nullptr;
+    BufferSubDataFn bufferSubData = nullptr;
+
+    // gl 2.1 pixel buffer objects (buffers + map/unmap)
+    bool hasPixelBuffers = false;
+    MapBufferFn mapBuffer = nullptr;
+    UnmapBufferFn unmapBuffer = nullptr;
+
+    // gl 4.4 persistently mapped buffers (ARB_buffer_storage) with fences (gl 3.2 / ARB_sync)
+    bool hasPersistentBuffers = false;
+    BufferStorageFn bufferStorage = nullptr;
+    MapBufferRangeFn mapBufferRange = nullptr;
+    FenceSyncFn fenceSync = nullptr;
+    ClientWaitSyncFn clientWaitSync = nullptr;
+    DeleteSyncFn deleteSync = nullptr;
+
+    // gl 2.0 glsl
+    bool hasShaders = false;
+    CreateShaderFn createShader = nullptr;
+    DeleteShaderFn deleteShader = nullptr;
+    ShaderSourceFn shaderSource = nullptr;
+    CompileShaderFn compileShader = nullptr;
+    GetShaderivFn getShaderiv = nullptr;
+    GetShaderInfoLogFn getShaderInfoLog = nullptr;
+    CreateProgramFn createProgram = nullptr;
+    DeleteProgramFn deleteProgram = nullptr;
+    AttachShaderFn attachShader = nullptr;
+    BindAttribLocationFn bindAttribLocation = nullptr;
+    LinkProgramFn linkProgram = nullptr;
+    GetProgramivFn getProgramiv = nullptr;
+    GetProgramInfoLogFn getProgramInfoLog = nullptr;
+    UseProgramFn useProgram = nullptr;
+    GetUniformLocationFn getUniformLocation = nullptr;
+    Uniform1iFn uniform1i = nullptr;
+    Uniform1fFn uniform1f = nullptr;
+    EnableVertexAttribArrayFn enableVertexAttribArray = nullptr;
+    DisableVertexAttribArrayFn disableVertexAttribArray = nullptr;
+    VertexAttribPointerFn vertexAttribPointer = nullptr;
+
+    // gl 3.3 (or ARB_instanced_arrays + ARB_draw_instanced) instancing
+    bool hasInstancing = false;
+    VertexAttribDivisorFn vertexAttribDivisor = nullptr;
+    DrawElementsInstancedFn drawElementsInstanced = nullptr;
+
+    // gl 1.3 compressed textures, and which block formats the driver takes
+    CompressedTexImage2DFn compressedTexImage2D = nullptr;
+    bool hasS3TC = false;   // bc1 / bc3
+    bool hasETC2 = false;   // gl 4.3 or ARB_ES3_compatibility
+
+    // gl 3.3 core profile: no fixed function, vertex array objects and
+    // uniform buffers instead, see CoreRenderer.h
+    bool coreProfile = false;
+    bool hasCoreRendering = false;
+    GenVertexArraysFn genVertexArrays = nullptr;
+    DeleteVertexArraysFn deleteVertexArrays = nullptr;
+    BindVertexArrayFn bindVertexArray = nullptr;
+    GetUniformBlockIndexFn getUniformBlockIndex = nullptr;
+    UniformBlockBindingFn uniformBlockBinding = nullptr;
+    BindBufferRangeFn bindBufferRange = nullptr;
+    GetStringiFn getStringi = nullptr; // core profiles list extensions one by one
+};
+
+static GLExtensions glext;
+
+// where entry points come from, glut by default
+typedef void (*GLProc)();
+typedef GLProc (*GetProcAddressFn)(const char* name);
+
+inline GLProc glutProcAddress(const char* name) {
+    return reinterpret_cast<GLProc>(glutGetProcAddress(name));
+}
+
+// true if the current context is at least the given gl version
+inline bool glVersionAtLeast(int major, int minor) {
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if (!version) return false;
+
+    int ctxMajor = 0, ctxMinor = 0;
+    if (sscanf(version, "%d.%d", &ctxMajor, &ctxMinor) != 2) return false;
+    return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+}
+
+// core profiles have no GL_EXTENSIONS string, they are asked one by one
+inline bool hasGLExtension(const char* name) {
+    if (glext.coreProfile) {
+        if (!glext.getStringi) return false;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char* extension = reinterpret_cast<const char*>(glext.getStringi(GL_EXTENSIONS, i));
+            if (extension && strcmp(extension, name) == 0) return true;
+        }
+        return false;
+    }
+
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (!extensions) return false;
+
+    size_t length = strlen(name);
+    for (const char* at = strstr(extensions, name); at; at = strstr(at + length, name)) {
+        bool startsWord = at == extensions || at[-1] == ' ';
+        bool endsWord = at[length] == ' ' || at[length] == '\0';
+        if (startsWord && endsWord) return true;
+    }
+    return false;
+}
+
+// needs a current context
+inline void loadGLExtensions(GetProcAddressFn getProc = glutProcAddress) {
+    GLint profile = 0;
+    if (glVersionAtLeast(3, 2)) glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+    glext.coreProfile = (profile & GL_CONTEXT_CORE_PROFILE_BIT) != 0;
+    glext.getStringi = reinterpret_cast<GetStringiFn>(getProc("glGetStringi"));
+
+    glext.genBuffers = reinterpret_cast<GenBuffersFn>(getProc("glGenBuffers"));
+    glext.deleteBuffers = reinterpret_cast<DeleteBuffersFn>(getProc("glDeleteBuffers"));
+    glext.bindBuffer = reinterpret_cast<BindBufferFn>(getProc("glBindBuffer"));
+    glext.bufferData = reinterpret_cast<BufferDataFn>(getProc("glBufferData"));
+    glext.bufferSubData = reinterpret_cast<BufferSubDataFn>(getProc("glBufferSubData"));
+    glext.hasBuffers = glVersionAtLeast(1, 5) &&
+        glext.genBuffers && glext.deleteBuffers && glext.bindBuffer &&
+        glext.bufferData && glext.bufferSubData;
+
+    glext.mapBuffer = reinterpret_cast<MapBufferFn>(getProc("glMapBuffer"));
+    glext.unmapBuffer = reinterpret_cast<UnmapBufferFn>(getProc("glUnmapBuffer"));
+    glext.hasPixelBuffers = glext.hasBuffers && glext.mapBuffer && glext.unmapBuffer &&
+        (glVersionAtLeast(2, 1) || hasGLExtension("GL_ARB_pixel_buffer_object"));
+
+    glext.bufferStorage = reinterpret_cast<BufferStorageFn>(getProc("glBufferStorage"));
+    glext.mapBufferRange = reinterpret_cast<MapBufferRangeFn>(getProc("glMapBufferRange"));
+    glext.fenceSync = reinterpret_cast<FenceSyncFn>(getProc("glFenceSync"));
+    glext.clientWaitSync = reinterpret_cast<ClientWaitSyncFn>(getProc("glClientWaitSync"));
+    glext.deleteSync = reinterpret_cast<DeleteSyncFn>(getProc("glDeleteSync"));
+    glext.hasPersistentBuffers = glext.hasPixelBuffers &&
+        (glVersionAtLeast(4, 4) || (hasGLExtension("GL_ARB_buffer_storage") && hasGLExtension("GL_ARB_sync"))) &&
+        glext.bufferStorage && glext.mapBufferRange && glext.fenceSync && glext.clientWaitSync && glext.deleteSync;
+
+    glext.createShader = reinterpret_cast<CreateShaderFn>(getProc("glCreateShader"));
+    glext.deleteShader = reinterpret_cast<DeleteShaderFn>(getProc("glDeleteShader"));
+    glext.shaderSource = reinterpret_cast<ShaderSourceFn>(getProc("glShaderSource"));
+    glext.compileShader = reinterpret_cast<CompileShaderFn>(getProc("glCompileShader"));
+    glext.getShaderiv = reinterpret_cast<GetShaderivFn>(getProc("glGetShaderiv"));
+    glext.getShaderInfoLog = reinterpret_cast<GetShaderInfoLogFn>(getProc("glGetShaderInfoLog"));
+    glext.createProgram = reinterpret_cast<CreateProgramFn>(getProc("glCreateProgram"));
+    glext.deleteProgram = reinterpret_cast<DeleteProgramFn>(getProc("glDeleteProgram"));
+    glext.attachShader = reinterpret_cast<AttachShaderFn>(getProc("glAttachShader"));
+    glext.bindAttribLocation = reinterpret_cast<BindAttribLocationFn>(getProc("glBindAttribLocation"));
+    glext.linkProgram = reinterpret_cast<LinkProgramFn>(getProc("glLinkProgram"));
+    glext.getProgramiv = reinterpret_cast<GetProgramivFn>(getProc("glGetProgramiv"));
+    glext.getProgramInfoLog = reinterpret_cast<GetProgramInfoLogFn>(getProc("glGetProgramInfoLog"));
+    glext.useProgram = reinterpret_cast<UseProgramFn>(getProc("glUseProgram"));
+    glext.getUniformLocation = reinterpret_cast<GetUniformLocationFn>(getProc("glGetUniformLocation"));
+    glext.uniform1i = reinterpret_cast<Uniform1iFn>(getProc("glUniform1i"));
+    glext.uniform1f = reinterpret_cast<Uniform1fFn>(getProc("glUniform1f"));
+    glext.enableVertexAttribArray = reinterpret_cast<EnableVertexAttribArrayFn>(getProc("glEnableVertexAttribArray"));
+    glext.disableVertexAttribArray = reinterpret_cast<DisableVertexAttribArrayFn>(getProc("glDisableVertexAttribArray"));
+    glext.vertexAttribPointer = reinterpret_cast<VertexAttribPointerFn>(getProc("glVertexAttribPointer"));
+    glext.hasShaders = glVersionAtLeast(2, 0) &&
+        glext.createShader && glext.deleteShader && glext.shaderSource && glext.compileShader &&
+        glext.getShaderiv && glext.getShaderInfoLog && glext.createProgram && glext.deleteProgram &&
+        glext.attachShader && glext.bindAttribLocation && glext.linkProgram && glext.getProgramiv &&
+        glext.getProgramInfoLog && glext.useProgram && glext.getUniformLocation && glext.uniform1i &&
+        glext.uniform1f && glext.enableVertexAttribArray && glext.disableVertexAttribArray &&
+        glext.vertexAttribPointer;
+
+    bool coreInstancing = glVersionAtLeast(3, 3);
+    bool arbInstancing = hasGLExtension("GL_ARB_instanced_arrays") && hasGLExtension("GL_ARB_draw_instanced");
+    const char* divisorName = coreInstancing ? "glVertexAttribDivisor" : "glVertexAttribDivisorARB";
+    const char* drawName = coreInstancing ? "glDrawElementsInstanced" : "glDrawElementsInstancedARB";
+    glext.vertexAttribDivisor = reinterpret_cast<VertexAttribDivisorFn>(getProc(divisorName));
+    glext.drawElementsInstanced = reinterpret_cast<DrawElementsInstancedFn>(getProc(drawName));
+    glext.hasInstancing = (coreInstancing || arbInstancing) && glext.hasBuffers && glext.hasShaders &&
+        glext.vertexAttribDivisor && glext.drawElementsInstanced;
+
+    if (glVersionAtLeast(1, 3)) {
+        glext.compressedTexImage2D = reinterpret_cast<CompressedTexImage2DFn>(getProc("glCompressedTexImage2D"));
+    }
+    glext.hasS3TC = glext.compressedTexImage2D && hasGLExtension("GL_EXT_texture_compression_s3tc");
+    glext.hasETC2 = glext.compressedTexImage2D && (glVersionAtLeast(4, 3) || hasGLExtension("GL_ARB_ES3_compatibility"));
+
+    glext.genVertexArrays = reinterpret_cast<GenVertexArraysFn>(getProc("glGenVertexArrays"));
+    glext.deleteVertexArrays = reinterpret_cast<DeleteVertexArraysFn>(getProc("glDeleteVertexArrays"));
+    glext.bindVertexArray = reinterpret_cast<BindVertexArrayFn>(getProc("glBindVertexArray"));
+    glext.getUniformBlockIndex = reinterpret_cast<GetUniformBlockIndexFn>(getProc("glGetUniformBlockIndex"));
+    glext.uniformBlockBinding = reinterpret_cast<UniformBlockBindingFn>(getProc("glUniformBlockBinding"));
+    glext.bindBufferRange = reinterpret_cast<BindBufferRangeFn>(getProc("glBindBufferRange"));
+    glext.hasCoreRendering = glext.coreProfile && glVersionAtLeast(3, 3) && glext.hasBuffers && glext.hasShaders &&
+        glext.hasInstancing && glext.mapBufferRange && glext.unmapBuffer && glext.genVertexArrays && glext.deleteVertexArrays && glext.bindVertexArray &&
+        glext.getUniformBlockIndex && glext.uniformBlockBinding && glext.bindBufferRange;
+}
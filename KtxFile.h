@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// minimal ktx 1.1 (khronos texture) files for block compressed 2d textures
+// with mip levels: no arrays, cube maps or key/value data. written by
+// TextureCompressor, read by TextureCache
+
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+struct KtxHeader {
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t glType;                // 0 for compressed data
+    uint32_t glTypeSize;            // 1 for compressed data
+    uint32_t glFormat;              // 0 for compressed data
+    uint32_t glInternalFormat;      // the compressed format enum
+    uint32_t glBaseInternalFormat;  // GL_RGB or GL_RGBA
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+struct KtxLevel {
+    size_t offset; // from the start of the file
+    size_t size;
+};
+
+// levels[i] is level i, written with its size in front as the format wants
+inline bool writeKtx(const char* filename, uint32_t internalFormat, uint32_t baseFormat, int width, int height,
+    const std::vector<std::vector<unsigned char>>& levels) {
+    KtxHeader header = {};
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_ENDIANNESS;
+    header.glTypeSize = 1;
+    header.glInternalFormat = internalFormat;
+    header.glBaseInternalFormat = baseFormat;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = static_cast<uint32_t>(levels.size());
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) return false;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (const auto& level : levels) {
+        uint32_t size = static_cast<uint32_t>(level.size());
+        written = written && fwrite(&size, 4, 1, file) == 1 && fwrite(level.data(), 1, size, file) == size;
+        // levels are padded to 4 bytes, blocks are 8 or 16 so this never writes anything
+        static const unsigned char padding[3] = { 0, 0, 0 };
+        size_t pad = (4 - size % 4) % 4;
+        written = written && fwrite(padding, 1, pad, file) == pad;
+    }
+    written = fclose(file) == 0 && written;
+    return written;
+}
+
+// checks the header and finds every level inside data. little endian files only
+inline bool parseKtx(const unsigned char* data, size_t size, KtxHeader& header, std::vector<KtxLevel>& levels) {
+    if (size < sizeof(KtxHeader)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0) return false;
+    if (header.endianness != KTX_ENDIANNESS || header.glType != 0 || header.glFormat != 0) return false;
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1) return false;
+    if (header.numberOfArrayElements > 1 || header.numberOfFaces != 1) return false;
+
+    size_t offset = sizeof(KtxHeader) + header.bytesOfKeyValueData;
+    uint32_t count = header.numberOfMipmapLevels == 0 ? 1 : header.numberOfMipmapLevels;
+    levels.clear();
+    for (uint32_t level = 0; level < count; level++) {
+        if (offset + 4 > size) return false;
+        uint32_t levelSize;
+        memcpy(&levelSize, data + offset, 4);
+        offset += 4;
+        if (offset + levelSize > size) return false;
+        levels.push_back({ offset, levelSize });
+        offset += (levelSize + 3) & ~3u;
+    }
+    return true;
+}
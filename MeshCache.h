@@ -0,0 +1,284 @@
+#pragma once
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+#include "GLExtensions.h"
+
+// sphere and cylinder meshes built once and drawn from vertex arrays,
+// instead of re-tessellating through glu quadrics every frame.
+// the layout and texture coordinates follow gluSphere / gluCylinder so
+// textures line up the same way they used to
+
+const float MESH_PI = 3.14159265f;
+
+struct Mesh {
+    std::vector<float> vertices; // interleaved: x y z, nx ny nz, s t
+    std::vector<GLuint> indices; // triangles
+    GLuint vbo = 0;              // 0 means draw straight from the vectors above
+    GLuint ibo = 0;
+    GLuint vao = 0;              // core profile only, the layout below on the MESH_*_ATTRIB slots
+};
+
+const int MESH_VERTEX_FLOATS = 8;
+const GLsizei MESH_STRIDE = MESH_VERTEX_FLOATS * sizeof(float);
+
+// generic attribute slots of the core profile shaders, see CoreRenderer.h
+const GLuint MESH_POSITION_ATTRIB = 0;
+const GLuint MESH_NORMAL_ATTRIB = 1;
+const GLuint MESH_TEXCOORD_ATTRIB = 2;
+
+inline void addMeshVertex(Mesh& mesh, float x, float y, float z, float nx, float ny, float nz, float s, float t) {
+    float v[MESH_VERTEX_FLOATS] = { x, y, z, nx, ny, nz, s, t };
+    mesh.vertices.insert(mesh.vertices.end(), v, v + MESH_VERTEX_FLOATS);
+}
+
+// unit sphere around the z axis, scale it with glScalef
+inline Mesh buildSphereMesh(int slices, int stacks) {
+    Mesh mesh;
+    for (int j = 0; j <= stacks; j++) {
+        float rho = MESH_PI * j / stacks;
+        for (int i = 0; i <= slices; i++) {
+            float theta = 2.0f * MESH_PI * (i == slices ? 0 : i) / slices;
+            float x = sinf(theta) * sinf(rho);
+            float y = cosf(theta) * sinf(rho);
+            float z = cosf(rho);
+            addMeshVertex(mesh, x, y, z, x, y, z,
+                1.0f - static_cast<float>(i) / slices, 1.0f - static_cast<float>(j) / stacks);
+        }
+    }
+
+    for (int j = 0; j < stacks; j++) {
+        for (int i = 0; i < slices; i++) {
+            GLuint a = j * (slices + 1) + i;
+            GLuint b = a + slices + 1;
+            GLuint tri[6] = { a, a + 1, b, a + 1, b + 1, b };
+            mesh.indices.insert(mesh.indices.end(), tri, tri + 6);
+        }
+    }
+    return mesh;
+}
+
+// open cylinder along +z like gluCylinder, topRadius 0 makes a cone
+inline Mesh buildCylinderMesh(float baseRadius, float topRadius, float height, int slices, int stacks) {
+    Mesh mesh;
+
+    // side normals lean towards +z when the cylinder narrows
+    float deltaRadius = baseRadius - topRadius;
+    float length = sqrtf(deltaRadius * deltaRadius + height * height);
+    float zNormal = deltaRadius / length;
+    float xyNormal = height / length;
+
+    for (int j = 0; j <= stacks; j++) {
+        float radius = baseRadius - deltaRadius * j / stacks;
+        float z = height * j / stacks;
+        for (int i = 0; i <= slices; i++) {
+            float theta = 2.0f * MESH_PI * (i == slices ? 0 : i) / slices;
+            addMeshVertex(mesh, radius * sinf(theta), radius * cosf(theta), z,
+                xyNormal * sinf(theta), xyNormal * cosf(theta), zNormal,
+                1.0f - static_cast<float>(i) / slices, static_cast<float>(j) / stacks);
+        }
+    }
+
+    for (int j = 0; j < stacks; j++) {
+        for (int i = 0; i < slices; i++) {
+            GLuint a = j * (slices + 1) + i;
+            GLuint b = a + slices + 1;
+            GLuint tri[6] = { a, b, a + 1, a + 1, b, b + 1 };
+            mesh.indices.insert(mesh.indices.end(), tri, tri + 6);
+        }
+    }
+    return mesh;
+}
+
+// flat quad cut into subdivisions x subdivisions cells, so per vertex
+// lighting has more than four points to work with. corners go around the
+// quad like a GL_QUADS quad, positions and texture coordinates are
+// interpolated between them. appends to mesh, so several quads can share one
+inline void addQuadGrid(Mesh& mesh, const float corners[4][3], const float texCoords[4][2], const float normal[3], int subdivisions) {
+    GLuint first = static_cast<GLuint>(mesh.vertices.size() / MESH_VERTEX_FLOATS);
+    for (int j = 0; j <= subdivisions; j++) {
+        float v = static_cast<float>(j) / subdivisions;
+        for (int i = 0; i <= subdivisions; i++) {
+            float u = static_cast<float>(i) / subdivisions;
+            // bilinear weights of corners 0, 1, 2, 3
+            float w[4] = { (1 - u) * (1 - v), u * (1 - v), u * v, (1 - u) * v };
+            float p[3] = {}, t[2] = {};
+            for (int c = 0; c < 4; c++) {
+                for (int k = 0; k < 3; k++) p[k] += w[c] * corners[c][k];
+                for (int k = 0; k < 2; k++) t[k] += w[c] * texCoords[c][k];
+            }
+            addMeshVertex(mesh, p[0], p[1], p[2], normal[0], normal[1], normal[2], t[0], t[1]);
+        }
+    }
+
+    for (int j = 0; j < subdivisions; j++) {
+        for (int i = 0; i < subdivisions; i++) {
+            GLuint a = first + j * (subdivisions + 1) + i;
+            GLuint b = a + subdivisions + 1;
+            GLuint tri[6] = { a, a + 1, b + 1, a, b + 1, b };
+            mesh.indices.insert(mesh.indices.end(), tri, tri + 6);
+        }
+    }
+}
+
+// copy the mesh into buffer objects when the driver has them. a core
+// profile draws nothing without a vertex array object, so it gets one too
+inline void uploadMesh(Mesh& mesh) {
+    if (!glext.hasBuffers || mesh.vbo) return;
+
+    if (glext.hasCoreRendering) {
+        glext.genVertexArrays(1, &mesh.vao);
+        glext.bindVertexArray(mesh.vao);
+    }
+
+    glext.genBuffers(1, &mesh.vbo);
+    glext.bindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glext.bufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(float), mesh.vertices.data(), GL_STATIC_DRAW);
+
+    glext.genBuffers(1, &mesh.ibo);
+    glext.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+    glext.bufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint), mesh.indices.data(), GL_STATIC_DRAW);
+
+    if (mesh.vao) {
+        // the element buffer binding is part of the vertex array, so it stays bound
+        const char* base = nullptr;
+        glext.vertexAttribPointer(MESH_POSITION_ATTRIB, 3, GL_FLOAT, GL_FALSE, MESH_STRIDE, base);
+        glext.vertexAttribPointer(MESH_NORMAL_ATTRIB, 3, GL_FLOAT, GL_FALSE, MESH_STRIDE, base + 3 * sizeof(float));
+        glext.vertexAttribPointer(MESH_TEXCOORD_ATTRIB, 2, GL_FLOAT, GL_FALSE, MESH_STRIDE, base + 6 * sizeof(float));
+        glext.enableVertexAttribArray(MESH_POSITION_ATTRIB);
+        glext.enableVertexAttribArray(MESH_NORMAL_ATTRIB);
+        glext.enableVertexAttribArray(MESH_TEXCOORD_ATTRIB);
+        glext.bindVertexArray(0);
+        glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+
+    glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+    glext.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// set up the client arrays for a mesh, then drawMeshElements() as many times as needed
+inline void bindMesh(const Mesh& mesh) {
+    const float* base = mesh.vertices.data();
+    if (mesh.vbo) {
+        glext.bindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+        glext.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+        base = nullptr; // offsets into the buffer from here on
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, MESH_STRIDE, base);
+    glNormalPointer(GL_FLOAT, MESH_STRIDE, base + 3);
+    glTexCoordPointer(2, GL_FLOAT, MESH_STRIDE, base + 6);
+}
+
+inline void drawMeshElements(const Mesh& mesh) {
+    const GLuint* indices = mesh.ibo ? nullptr : mesh.indices.data();
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, indices);
+}
+
+inline void unbindMesh(const Mesh& mesh) {
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    if (mesh.vbo) {
+        glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+        glext.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
+
+inline void drawMesh(const Mesh& mesh) {
+    bindMesh(mesh);
+    drawMeshElements(mesh);
+    unbindMesh(mesh);
+}
+
+// builds every mesh the first time it is asked for and keeps it for the
+// lifetime of the program
+class MeshCache {
+public:
+    const Mesh& sphere(int slices, int stacks) {
+        auto key = std::make_tuple(slices, stacks);
+        auto it = spheres.find(key);
+        if (it == spheres.end()) {
+            it = spheres.emplace(key, buildSphereMesh(slices, stacks)).first;
+            uploadMesh(it->second);
+        }
+        return it->second;
+    }
+
+    const Mesh& cylinder(float baseRadius, float topRadius, float height, int slices, int stacks) {
+        auto key = std::make_tuple(baseRadius, topRadius, height, slices, stacks);
+        auto it = cylinders.find(key);
+        if (it == cylinders.end()) {
+            it = cylinders.emplace(key, buildCylinderMesh(baseRadius, topRadius, height, slices, stacks)).first;
+            uploadMesh(it->second);
+        }
+        return it->second;
+    }
+
+private:
+    std::map<std::tuple<int, int>, Mesh> spheres;
+    std::map<std::tuple<float, float, float, int, int>, Mesh> cylinders;
+};
+
+// radius in pixels of a sphere seen from distance away through a
+// gluPerspective projection with vertical field of view fovY (degrees)
+// on a viewport viewportHeight pixels high
+inline float projectedRadius(float radius, float distance, float fovY, int viewportHeight) {
+    if (distance <= radius) return static_cast<float>(viewportHeight); // the camera is inside it
+    return radius / distance * (viewportHeight * 0.5f) / tanf(fovY * 0.5f * MESH_PI / 180.0f);
+}
+
+// level of detail for spheres: the same unit sphere tessellated a few
+// times, detail halving per level, and a pick per object from its size on
+// screen. a level is fine while each slice covers at most
+// LOD_PIXELS_PER_SLICE pixels of the outline, so far or small spheres drop
+// to a fraction of the triangles without looking any less round
+const float LOD_PIXELS_PER_SLICE = 8.0f;
+
+class SphereLod {
+public:
+    // level 0 is maxDetail x maxDetail, the last is at least minDetail
+    void init(MeshCache& cache, int maxDetail, int minDetail = 6) {
+        meshes.clear();
+        details.clear();
+        for (int detail = maxDetail; ; detail /= 2) {
+            meshes.push_back(&cache.sphere(detail, detail));
+            details.push_back(detail);
+            if (detail / 2 < minDetail) break;
+        }
+    }
+
+    int levels() const { return static_cast<int>(meshes.size()); }
+    int detail(int level) const { return details[level]; }
+    const Mesh& mesh(int level) const { return *meshes[level]; }
+
+    // the coarsest level that still has enough slices, 0 when disabled
+    int pick(float screenRadius) const {
+        if (!enabled) return 0;
+        float slicesNeeded = 2.0f * MESH_PI * screenRadius / LOD_PIXELS_PER_SLICE;
+        for (int level = levels() - 1; level > 0; level--) {
+            if (details[level] >= slicesNeeded) return level;
+        }
+        return 0;
+    }
+
+    // triangle counters for stats, what was drawn against what level 0 would have cost
+    void countDrawn(int level, int objects = 1) {
+        trianglesDrawn += static_cast<long long>(meshes[level]->indices.size() / 3) * objects;
+        trianglesFull += static_cast<long long>(meshes[0]->indices.size() / 3) * objects;
+    }
+
+    bool enabled = true;
+    long long trianglesDrawn = 0;
+    long long trianglesFull = 0;
+
+private:
+    std::vector<const Mesh*> meshes;
+    std::vector<int> details;
+};
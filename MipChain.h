@@ -0,0 +1,255 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// rgba8 mip chains kept in one block, level 0 first and every level right
+// after the previous one. levels halve down to 1x1, odd sizes round down.
+// two downsampling filters: a 2x2 box (cheap, a little blurry) and a 6 tap
+// kaiser windowed sinc (sharper, costs more). both use sse2 where available
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_CHAIN_SSE2
+#endif
+
+enum MipFilter {
+    MIP_FILTER_BOX,
+    MIP_FILTER_KAISER,
+};
+
+inline const char* mipFilterName(MipFilter filter) {
+    return filter == MIP_FILTER_KAISER ? "kaiser" : "box";
+}
+
+inline int mipLevelCount(int width, int height) {
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+inline int mipWidth(int width, int level) {
+    return std::max(1, width >> level);
+}
+
+inline int mipHeight(int height, int level) {
+    return std::max(1, height >> level);
+}
+
+// byte offset of a level inside the chain
+inline size_t mipLevelOffset(int width, int height, int level) {
+    size_t offset = 0;
+    for (int i = 0; i < level; i++) {
+        offset += static_cast<size_t>(mipWidth(width, i)) * mipHeight(height, i) * 4;
+    }
+    return offset;
+}
+
+// bytes for the whole chain
+inline size_t mipChainSize(int width, int height) {
+    return mipLevelOffset(width, height, mipLevelCount(width, height));
+}
+
+// 2x2 box filter from one level to the next. a side that is already 1
+// pixel reuses it instead of reading past the edge
+inline void downsampleBox(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* target) {
+    int width = std::max(1, sourceWidth / 2);
+    int height = std::max(1, sourceHeight / 2);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row0 = source + static_cast<size_t>(std::min(y * 2, sourceHeight - 1)) * sourceWidth * 4;
+        const unsigned char* row1 = source + static_cast<size_t>(std::min(y * 2 + 1, sourceHeight - 1)) * sourceWidth * 4;
+        int x = 0;
+
+#if defined(MIP_CHAIN_SSE2)
+        // 4 target pixels from 8x2 source pixels: widen to 16 bits, add the
+        // rows, add neighbouring pixels, round and narrow back
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi16(2);
+        for (; sourceWidth > 1 && x + 4 <= width; x += 4) {
+            __m128i top0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+            __m128i top1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16));
+            __m128i bottom0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+            __m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16));
+
+            // every register holds two source pixels summed over both rows
+            __m128i pair0 = _mm_add_epi16(_mm_unpacklo_epi8(top0, zero), _mm_unpacklo_epi8(bottom0, zero));
+            __m128i pair1 = _mm_add_epi16(_mm_unpackhi_epi8(top0, zero), _mm_unpackhi_epi8(bottom0, zero));
+            __m128i pair2 = _mm_add_epi16(_mm_unpacklo_epi8(top1, zero), _mm_unpacklo_epi8(bottom1, zero));
+            __m128i pair3 = _mm_add_epi16(_mm_unpackhi_epi8(top1, zero), _mm_unpackhi_epi8(bottom1, zero));
+
+            // low half + high half = one target pixel in the low 4 lanes
+            pair0 = _mm_add_epi16(pair0, _mm_srli_si128(pair0, 8));
+            pair1 = _mm_add_epi16(pair1, _mm_srli_si128(pair1, 8));
+            pair2 = _mm_add_epi16(pair2, _mm_srli_si128(pair2, 8));
+            pair3 = _mm_add_epi16(pair3, _mm_srli_si128(pair3, 8));
+
+            __m128i first = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(pair0, pair1), rounding), 2);
+            __m128i second = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(pair2, pair3), rounding), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target), _mm_packus_epi16(first, second));
+            target += 16;
+        }
+#endif
+
+        for (; x < width; x++) {
+            int x0 = std::min(x * 2, sourceWidth - 1) * 4;
+            int x1 = std::min(x * 2 + 1, sourceWidth - 1) * 4;
+            for (int c = 0; c < 4; c++) {
+                target[c] = static_cast<unsigned char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+            }
+            target += 4;
+        }
+    }
+}
+
+// kaiser windowed sinc for halving, 6 taps centred between source pixels
+// 2i and 2i+1. the weights are the same for every target pixel
+const int KAISER_TAPS = 6;
+const float KAISER_ALPHA = 4.0f;
+
+// modified bessel function of the first kind, order 0, by its series
+inline double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+inline void kaiserWeights(float* weights) {
+    const double pi = 3.14159265358979;
+    const double radius = KAISER_TAPS / 4.0; // in target pixels
+    double total = 0.0;
+    double w[KAISER_TAPS];
+    for (int tap = 0; tap < KAISER_TAPS; tap++) {
+        double x = (tap - KAISER_TAPS / 2 + 0.5) / 2.0; // distance in target pixels
+        double sinc = x == 0.0 ? 1.0 : sin(pi * x) / (pi * x);
+        double t = x / radius;
+        double window = besselI0(KAISER_ALPHA * sqrt(std::max(0.0, 1.0 - t * t))) / besselI0(KAISER_ALPHA);
+        w[tap] = sinc * window;
+        total += w[tap];
+    }
+    for (int tap = 0; tap < KAISER_TAPS; tap++) {
+        weights[tap] = static_cast<float>(w[tap] / total);
+    }
+}
+
+#if defined(MIP_CHAIN_SSE2)
+// one rgba8 pixel as 4 floats
+inline __m128 loadPixelFloats(const unsigned char* pixel) {
+    int packed;
+    memcpy(&packed, pixel, 4);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i value = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(value, zero));
+}
+#endif
+
+// separable: a horizontal pass into floats, then a vertical pass back to
+// bytes, one rgba pixel per sse register. edges are clamped and so is the
+// result, the sinc lobes can overshoot 0..255
+inline void downsampleKaiser(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* target) {
+    int width = std::max(1, sourceWidth / 2);
+    int height = std::max(1, sourceHeight / 2);
+    float weights[KAISER_TAPS];
+    kaiserWeights(weights);
+    const int first = -(KAISER_TAPS / 2 - 1); // first tap relative to 2i
+
+    // a side that is already 1 pixel is copied through instead of filtered
+    bool filterX = sourceWidth > 1;
+    bool filterY = sourceHeight > 1;
+
+    std::vector<float> rows(static_cast<size_t>(width) * sourceHeight * 4);
+    for (int y = 0; y < sourceHeight; y++) {
+        const unsigned char* in = source + static_cast<size_t>(y) * sourceWidth * 4;
+        float* out = &rows[static_cast<size_t>(y) * width * 4];
+        for (int x = 0; x < width; x++) {
+            if (!filterX) {
+                for (int c = 0; c < 4; c++) out[x * 4 + c] = in[c];
+                continue;
+            }
+#if defined(MIP_CHAIN_SSE2)
+            __m128 sum = _mm_setzero_ps();
+            for (int tap = 0; tap < KAISER_TAPS; tap++) {
+                int sx = std::min(std::max(x * 2 + first + tap, 0), sourceWidth - 1);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[tap]), loadPixelFloats(in + sx * 4)));
+            }
+            _mm_storeu_ps(out + x * 4, sum);
+#else
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int tap = 0; tap < KAISER_TAPS; tap++) {
+                int sx = std::min(std::max(x * 2 + first + tap, 0), sourceWidth - 1);
+                for (int c = 0; c < 4; c++) sum[c] += weights[tap] * in[sx * 4 + c];
+            }
+            memcpy(out + x * 4, sum, sizeof(sum));
+#endif
+        }
+    }
+
+    for (int y = 0; y < height; y++) {
+        const float* taps[KAISER_TAPS];
+        for (int tap = 0; tap < KAISER_TAPS; tap++) {
+            int sy = filterY ? std::min(std::max(y * 2 + first + tap, 0), sourceHeight - 1) : 0;
+            taps[tap] = &rows[static_cast<size_t>(sy) * width * 4];
+        }
+        unsigned char* out = target + static_cast<size_t>(y) * width * 4;
+        int count = width * 4;
+        int i = 0;
+
+#if defined(MIP_CHAIN_SSE2)
+        const __m128 lowest = _mm_setzero_ps();
+        const __m128 highest = _mm_set1_ps(255.0f);
+        for (; i + 4 <= count; i += 4) {
+            __m128 sum;
+            if (filterY) {
+                sum = _mm_setzero_ps();
+                for (int tap = 0; tap < KAISER_TAPS; tap++) {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[tap]), _mm_loadu_ps(taps[tap] + i)));
+                }
+            }
+            else {
+                sum = _mm_loadu_ps(taps[0] + i);
+            }
+            __m128i value = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(sum, lowest), highest));
+            value = _mm_packs_epi32(value, value);
+            int packed = _mm_cvtsi128_si32(_mm_packus_epi16(value, value));
+            memcpy(out + i, &packed, 4);
+        }
+#endif
+
+        for (; i < count; i++) {
+            float sum = 0.0f;
+            if (filterY) {
+                for (int tap = 0; tap < KAISER_TAPS; tap++) sum += weights[tap] * taps[tap][i];
+            }
+            else {
+                sum = taps[0][i];
+            }
+            out[i] = static_cast<unsigned char>(std::min(std::max(sum, 0.0f), 255.0f) + 0.5f);
+        }
+    }
+}
+
+// fills every level after 0, chain must hold mipChainSize(width, height) bytes
+inline void buildMipChain(unsigned char* chain, int width, int height, MipFilter filter = MIP_FILTER_BOX) {
+    int levels = mipLevelCount(width, height);
+    unsigned char* source = chain;
+    for (int level = 1; level < levels; level++) {
+        int sourceWidth = mipWidth(width, level - 1);
+        int sourceHeight = mipHeight(height, level - 1);
+        unsigned char* target = source + static_cast<size_t>(sourceWidth) * sourceHeight * 4;
+        if (filter == MIP_FILTER_KAISER) {
+            downsampleKaiser(source, sourceWidth, sourceHeight, target);
+        }
+        else {
+            downsampleBox(source, sourceWidth, sourceHeight, target);
+        }
+        source = target;
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+#include "GLExtensions.h"
+
+// offscreen rendering for benchmarks without a display or gpu. build with
+// -DOFFSCREEN and link -lEGL: the context comes from egl, on mesa's
+// surfaceless platform when available (llvmpipe renders into a pbuffer, no
+// X server needed). glut cannot be used at all in this mode, it refuses to
+// do anything without glutInit, which needs a display
+
+#ifdef OFFSCREEN
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+#ifndef EGL_CONTEXT_MAJOR_VERSION_KHR
+#define EGL_CONTEXT_MAJOR_VERSION_KHR 0x3098
+#define EGL_CONTEXT_MINOR_VERSION_KHR 0x30FB
+#define EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR 0x30FD
+#define EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR 0x00000001
+#endif
+
+inline GLProc eglProcAddress(const char* name) {
+    return reinterpret_cast<GLProc>(eglGetProcAddress(name));
+}
+
+// makes a width x height pbuffer context current, compatibility profile or
+// with coreProfile a gl 3.3 core one (CoreRenderer.h)
+inline bool createOffscreenContext(int width, int height, bool coreProfile = false) {
+    typedef EGLDisplay (EGLAPIENTRY* GetPlatformDisplayFn)(EGLenum platform, void* nativeDisplay, const EGLint* attribs);
+    GetPlatformDisplayFn getPlatformDisplay =
+        reinterpret_cast<GetPlatformDisplayFn>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        printf("Failed to initialize EGL\n");
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE,
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+        printf("No EGL config for an offscreen OpenGL pbuffer\n");
+        return false;
+    }
+
+    const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint coreAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE,
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, coreProfile ? coreAttribs : nullptr);
+    if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+        printf("Failed to create the offscreen context (EGL error 0x%x)\n", eglGetError());
+        return false;
+    }
+    return true;
+}
+#endif
+
+// reads the current framebuffer back into a binary ppm
+inline bool writeFramePPM(const char* filename, int width, int height) {
+    std::vector<unsigned char> pixels(width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) return false;
+
+    // gl rows go bottom up, ppm rows top down
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int y = height - 1; y >= 0; y--) {
+        fwrite(&pixels[y * width * 3], 1, width * 3, file);
+    }
+    fclose(file);
+    return true;
+}
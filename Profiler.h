@@ -0,0 +1,179 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// scoped cpu timers. PROFILE_SCOPE("name") times the rest of the block.
+// every scope is kept as a trace event (chrome://tracing or perfetto can open
+// the exported json) and summed per frame for the on screen overlay.
+// scope names must be string literals, they are compared by pointer
+
+struct ProfileEvent {
+    const char* name;
+    double startUs;
+    double durationUs;
+    int depth;
+};
+
+struct ProfileStat {
+    const char* name;
+    int depth;           // nesting of the first call, for indenting the overlay
+    double frameMs;      // summed over the current frame
+    double averageMs;    // smoothed over the last frames
+    int calls;           // in the current frame
+};
+
+class Profiler {
+public:
+    bool enabled = false;        // collect at all
+    bool recordTrace = false;    // keep every event for the trace export
+    size_t maxTraceEvents = 1000000;
+
+    Profiler() : origin(std::chrono::steady_clock::now()) {}
+
+    double nowUs() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void begin() {
+        depth++;
+    }
+
+    void end(const char* name, double startUs) {
+        depth--;
+        double durationUs = nowUs() - startUs;
+
+        if (recordTrace && trace.size() < maxTraceEvents) {
+            trace.push_back({ name, startUs, durationUs, depth });
+        }
+
+        ProfileStat& stat = statFor(name);
+        stat.frameMs += durationUs / 1000.0;
+        stat.calls++;
+    }
+
+    // call once per frame before the first scope
+    void beginFrame() {
+        if (!enabled) return;
+        frameOpen = true;
+        frameStartUs = nowUs();
+        for (auto& stat : stats) {
+            stat.frameMs = 0.0;
+            stat.calls = 0;
+        }
+    }
+
+    // call once per frame after the last scope
+    void endFrame() {
+        if (!enabled || !frameOpen) return;
+        frameOpen = false;
+        double frameMs = (nowUs() - frameStartUs) / 1000.0;
+        averageFrameMs = averageFrameMs * (1.0 - SMOOTHING) + frameMs * SMOOTHING;
+        for (auto& stat : stats) {
+            stat.averageMs = stat.averageMs * (1.0 - SMOOTHING) + stat.frameMs * SMOOTHING;
+        }
+    }
+
+    const std::vector<ProfileStat>& frameStats() const { return stats; }
+    double frameMs() const { return averageFrameMs; }
+    size_t traceEventCount() const { return trace.size(); }
+
+    // chrome trace event format, complete ("X") events in microseconds
+    bool writeChromeTrace(const char* filename) const {
+        FILE* file = fopen(filename, "w");
+        if (!file) return false;
+
+        fprintf(file, "{\"traceEvents\":[\n");
+        for (size_t i = 0; i < trace.size(); i++) {
+            const ProfileEvent& event = trace[i];
+            fprintf(file, "{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}%s\n",
+                event.name, event.startUs, event.durationUs, i + 1 < trace.size() ? "," : "");
+        }
+        fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(file);
+        return true;
+    }
+
+private:
+    const double SMOOTHING = 0.05;
+
+    ProfileStat& statFor(const char* name) {
+        for (auto& stat : stats) {
+            if (stat.name == name) return stat;
+        }
+        stats.push_back({ name, depth, 0.0, 0.0, 0 });
+        return stats.back();
+    }
+
+    std::chrono::steady_clock::time_point origin;
+    std::vector<ProfileEvent> trace;
+    std::vector<ProfileStat> stats; // in order of first appearance
+    bool frameOpen = false;
+    double frameStartUs = 0.0;
+    double averageFrameMs = 0.0;
+    int depth = 0;
+};
+
+static Profiler profiler;
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : name(name), active(profiler.enabled) {
+        if (!active) return;
+        profiler.begin();
+        startUs = profiler.nowUs();
+    }
+
+    ~ProfileScope() {
+        if (active) profiler.end(name, startUs);
+    }
+
+private:
+    const char* name;
+    bool active;
+    double startUs = 0.0;
+};
+
+// avg / median / p99 / max of a list of frame times
+inline void printFrameTimeSummary(std::vector<double> frameMs) {
+    if (frameMs.empty()) return;
+
+    std::sort(frameMs.begin(), frameMs.end());
+    double total = 0.0;
+    for (double ms : frameMs) total += ms;
+
+    printf("frames:      %zu\n", frameMs.size());
+    printf("avg ms:      %.3f\n", total / frameMs.size());
+    printf("median ms:   %.3f\n", frameMs[frameMs.size() / 2]);
+    printf("p99 ms:      %.3f\n", frameMs[frameMs.size() * 99 / 100]);
+    printf("max ms:      %.3f\n", frameMs.back());
+}
+
+// frame counts per frame time bucket, one bar each. long frames (hitches)
+// show up here even when the average hides them
+inline void printFrameTimeHistogram(const std::vector<double>& frameMs) {
+    if (frameMs.empty()) return;
+
+    const double limits[] = { 2.0, 4.0, 8.0, 16.7, 33.3, 66.7, 1e30 };
+    const char* labels[] = { "   < 2 ms", "   < 4 ms", "   < 8 ms", "< 16.7 ms", "< 33.3 ms", "< 66.7 ms", ">= 66.7 ms" };
+    const int buckets = sizeof(limits) / sizeof(limits[0]);
+    int counts[buckets] = {};
+    for (double ms : frameMs) {
+        int bucket = 0;
+        while (ms >= limits[bucket]) bucket++;
+        counts[bucket]++;
+    }
+
+    int largest = *std::max_element(counts, counts + buckets);
+    const int BAR_WIDTH = 40;
+    for (int bucket = 0; bucket < buckets; bucket++) {
+        int bar = counts[bucket] == 0 ? 0 : std::max(1, counts[bucket] * BAR_WIDTH / largest);
+        printf("%10s %6d %s\n", labels[bucket], counts[bucket], std::string(bar, '#').c_str());
+    }
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
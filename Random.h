@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+
+// pcg32 (pcg-random.org): small, fast and the same on every platform, unlike
+// rand(). the stream number picks one of 2^63 independent sequences, so every
+// subsystem can have its own generator off one seed without them overlapping
+// or disturbing each other
+class Pcg32 {
+public:
+    Pcg32() { seed(0, 0); }
+    Pcg32(uint64_t seedValue, uint64_t stream) { seed(seedValue, stream); }
+
+    void seed(uint64_t seedValue, uint64_t stream) {
+        state = 0;
+        increment = (stream << 1) | 1;
+        next();
+        state += seedValue;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        uint32_t xorShifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+        uint32_t rotation = static_cast<uint32_t>(old >> 59);
+        return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+    }
+
+    // uniform in [0, bound), without the modulo bias of rand() % bound
+    uint32_t below(uint32_t bound) {
+        uint32_t threshold = (0u - bound) % bound;
+        for (;;) {
+            uint32_t value = next();
+            if (value >= threshold) return value % bound;
+        }
+    }
+
+    // uniform in [0, 1)
+    float uniform() {
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float range(float from, float to) {
+        return from + (to - from) * uniform();
+    }
+
+private:
+    uint64_t state;
+    uint64_t increment;
+};
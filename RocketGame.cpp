@@ -2,10 +2,25 @@
 #include <vector>
 #include <cstdlib>
 #include <ctime>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
 #include <iostream>
 #include <GL/glut.h>
+#include "GLExtensions.h"
+#include "MeshCache.h"
+#include "Shaders.h"
+#include "CollisionSweep.h"
+#include "SpatialGrid.h"
+#include "Frustum.h"
+#include "CoreRenderer.h"
+#include "Random.h"
+#include "Profiler.h"
+#include "Offscreen.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "TextureCache.h"
 
 /* Checklist:
     - [x] 3D 
@@ -31,6 +46,36 @@
         - Both player and obstacles have sphere collisions
 */
 
+/* Command line:
+    --headless N        run N simulation ticks without a window and report ticks per second
+    --bench-frames N    render N frames (one tick each) as fast as possible, print frame times and exit
+    --legacy-geometry   draw with per-frame glu quadrics instead of the cached meshes
+    --no-lod            draw the earth and obstacles at full detail instead of coarser the smaller they are on screen
+    --no-culling        draw every obstacle instead of skipping the ones outside the view frustum
+    --no-instancing     draw obstacles one by one instead of with a single instanced draw call
+    --core-profile      draw through a gl 3.3 core context with per pixel lighting from uniform buffers (CoreRenderer.h)
+                        instead of the fixed function pipeline. no game over text or profiler overlay in this mode
+    --bench-collisions  time the collision sweep and the obstacle pair query at 10k, 100k and 1M obstacles and exit
+    --stars N           number of background stars (default 500)
+    --no-twinkle        keep the stars at a constant brightness
+    --seed N            seed for every random stream (default: current time), runs with the same seed match exactly
+    --record FILE       log every gameplay input with its tick to FILE
+    --replay FILE       feed a recorded session back through the headless simulation and check the end state
+    --trace FILE        write every profiler scope as chrome trace event json to FILE on exit
+    --offscreen N       render N frames into an egl pbuffer and print each frame's render time (offscreen build)
+    --dump-frames PATH  with --offscreen, also write the frames to PATH0000.ppm, PATH0001.ppm, ...
+    --sync-textures     load the textures before the first frame instead of on worker threads
+    --mip-filter F      box (default), kaiser, or off for plain GL_LINEAR without mipmaps
+    --anisotropy N      anisotropic filtering up to N samples (default 1 = off)
+    --no-compressed     ignore the block compressed .ktx textures from TextureCompressor
+    --stream-textures   upload decoded textures in 256x256 tiles through pixel buffers, spread over frames
+    --upload-budget KB  with --stream-textures, how much to upload per frame (default 1024)
+    P (in game)         toggle the profiler overlay
+
+   Build:           g++ RocketGame.cpp -lglut -lGLU -lGL -pthread
+   Offscreen build: g++ -DOFFSCREEN RocketGame.cpp -lglut -lGLU -lGL -lEGL -pthread
+*/
+
 
 // game constants
 const float PI = 3.14159265f;
@@ -38,6 +83,13 @@ const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 600;
 const float GAME_SPEED = .05F;
 const float ROCKET_SPEED = 0.1f;
+const double SIM_DT = 1.0 / 60.0;     // fixed simulation step in seconds
+const double MAX_FRAME_TIME = 0.25;   // avoid the spiral of death after a long stall
+const int MAX_OBSTACLES = 256;        // obstacle pool capacity
+const float DESPAWN_DISTANCE = 12.0f; // obstacles further than this on x are off screen
+const float GRID_CELL_SIZE = 1.0f;    // broad phase cells, at least one obstacle wide
+const float GRID_MIN_Y = 0.0f;        // obstacles spawn between y 0.5 and 4.4
+const float GRID_MAX_Y = 5.0f;
 
 // texture IDs
 GLuint earthTexture;
@@ -51,6 +103,7 @@ const float earthRotationSpeed = 0.1f;
 
 struct GameObject {
     float x, y, z;  // position
+    float prevX, prevY; // position at the previous tick, for interpolated drawing
     float radius;   // for collision detection
 };
 struct Rocket : GameObject {
@@ -58,34 +111,369 @@ struct Rocket : GameObject {
     float rotationY;
     bool isAlive;
 };
-struct Obstacle : GameObject {
-    float rotationSpeed;
-    float speed;
+
+// fixed capacity obstacle storage so spawning never touches the heap.
+// every field is its own array (index i is one obstacle) so the collision
+// sweep can load several obstacles at once. live obstacles stay packed at
+// the front, a despawned one is swapped with the last live one and its slot
+// is reused by the next spawn
+struct ObstaclePool {
+    alignas(32) float x[MAX_OBSTACLES];
+    alignas(32) float y[MAX_OBSTACLES];
+    alignas(32) float z[MAX_OBSTACLES];
+    alignas(32) float radius[MAX_OBSTACLES];
+    alignas(32) float prevX[MAX_OBSTACLES];
+    alignas(32) float prevY[MAX_OBSTACLES];
+    alignas(32) float rotationSpeed[MAX_OBSTACLES];
+    alignas(32) float speed[MAX_OBSTACLES];
+    int count = 0;
+    float maxRadius = 0.0f; // largest live radius, widens broad phase queries
+
+    // occupancy counters
+    int peak = 0;
+    long long spawned = 0;
+    long long recycled = 0;
+    long long dropped = 0; // spawns skipped because the pool was full
+
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // slot index, -1 when full
+    int acquire() {
+        if (count == MAX_OBSTACLES) {
+            dropped++;
+            return -1;
+        }
+        spawned++;
+        count++;
+        if (count > peak) peak = count;
+        return count - 1;
+    }
+
+    void release(int index) {
+        int last = count - 1;
+        x[index] = x[last];
+        y[index] = y[last];
+        z[index] = z[last];
+        radius[index] = radius[last];
+        prevX[index] = prevX[last];
+        prevY[index] = prevY[last];
+        rotationSpeed[index] = rotationSpeed[last];
+        speed[index] = speed[last];
+        count--;
+        recycled++;
+    }
+
+    void clear() {
+        count = 0;
+        maxRadius = 0.0f;
+    }
+};
+
+// random streams, one per subsystem and all derived from one seed so a run
+// can be repeated exactly. drawing never touches the gameplay stream
+enum RandomStream {
+    STREAM_SPAWN = 1,
+    STREAM_STARS = 2,
+    STREAM_BENCH = 3,
 };
+uint64_t gameSeed = 0;
+Pcg32 spawnRandom;
+Pcg32 starRandom;
 
 // game state
 Rocket rocket;
-std::vector<Obstacle> obstacles;
+ObstaclePool obstacles;
+
+// broad phase over the x/y plane the obstacles move in, rebuilt while
+// moveObstacleForward() walks the pool and extended on every spawn
+SpatialGrid2D obstacleGrid;
 float gameTime = 0.0f;
 float gameSpeed = .05f; // more speed more difficulty
 bool isFullscreen = false;
 bool gameOver = false;
 bool gamePaused = false;
 
+// fixed timestep loop, render alpha is how far we are between the last two ticks
+double simAccumulator = 0.0;
+float renderAlpha = 1.0f;
+float prevGameTime = 0.0f;
+float prevEarthRotationAngle = 0.0f;
+std::chrono::steady_clock::time_point lastFrameTime;
+
+// measured rates, refreshed once a second in the window title
+int simTicksThisSecond = 0;
+int framesThisSecond = 0;
+std::chrono::steady_clock::time_point rateWindowStart;
+
+// sphere/cylinder meshes built once in init()
+MeshCache meshCache;
+bool legacyGeometry = false;
+
+// level of detail: the earth and obstacle spheres get coarser the smaller
+// they are on screen, picked from the projection set up in reshape()
+SphereLod earthLod;
+SphereLod obstacleLod;
+const float FIELD_OF_VIEW = 45.0f; // vertical, degrees
+int viewportHeight = SCREEN_HEIGHT;
+std::vector<int> obstacleLevels;
+std::vector<int> obstacleLevelInstances; // per lod level, sized in initObstacleInstancing()
+
+// view frustum culling: obstacles entirely outside the camera's view are not
+// drawn, see cullObstacles(). planes from the gluLookAt in display() and the
+// projection in reshape()
+const float Z_NEAR = 0.1f;
+const float Z_FAR = 100.0f;
+Frustum viewFrustum;
+bool frustumCulling = true;
+float viewportAspect = (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT;
+alignas(32) float obstacleDrawX[MAX_OBSTACLES]; // interpolated x this frame
+unsigned char obstacleVisible[MAX_OBSTACLES];
+long long obstaclesDrawn = 0, obstaclesCulled = 0;
+
+// textures decode on worker threads and show a placeholder until they are
+// uploaded, time to first frame is measured from launch
+bool syncTextures = false;
+const std::chrono::steady_clock::time_point launchTime = std::chrono::steady_clock::now();
+bool firstFrameShown = false;
+
+// instanced obstacles: every obstacle transform goes into one buffer per frame
+// and the whole field is drawn with one call. attribute slots 6 and 7 stay
+// clear of the ones some drivers alias to the fixed function arrays
+const GLuint INSTANCE_POS_RADIUS_ATTRIB = 6;
+const GLuint INSTANCE_SPIN_ATTRIB = 7;
+const int INSTANCE_FLOATS = 5; // x y z radius spin
+bool useInstancing = true;
+GLuint obstacleProgram = 0;
+GLuint obstacleInstanceBuffer = 0;
+GLint obstacleUseTextureLocation = -1;
+std::vector<float> obstacleInstanceData;
+
+// same lighting as the fixed function pipeline for the directional light 0,
+// so instanced and per-object obstacles look the same
+const char* OBSTACLE_VERTEX_SHADER = R"(
+#version 120
+attribute vec4 instancePosRadius;
+attribute float instanceSpin;
+varying vec2 texCoord;
+varying vec4 litColor;
+
+// same as glRotatef(angle, 1, 1, 0)
+vec3 spin(vec3 v, float degrees) {
+    vec3 axis = vec3(0.70710678, 0.70710678, 0.0);
+    float c = cos(radians(degrees));
+    float s = sin(radians(degrees));
+    return v * c + cross(axis, v) * s + axis * dot(axis, v) * (1.0 - c);
+}
+
+void main() {
+    vec3 position = spin(gl_Vertex.xyz * instancePosRadius.w, instanceSpin) + instancePosRadius.xyz;
+    vec3 normal = normalize(gl_NormalMatrix * spin(gl_Normal, instanceSpin));
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(position, 1.0);
+
+    vec3 light = normalize(gl_LightSource[0].position.xyz);
+    float diffuse = max(dot(normal, light), 0.0);
+    vec4 color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient +
+        diffuse * gl_FrontLightProduct[0].diffuse;
+    if (diffuse > 0.0) {
+        vec3 halfVector = normalize(light + vec3(0.0, 0.0, 1.0));
+        float specular = pow(max(dot(normal, halfVector), 0.0), gl_FrontMaterial.shininess);
+        color += specular * gl_FrontLightProduct[0].specular;
+    }
+    litColor = clamp(color, 0.0, 1.0);
+    texCoord = gl_MultiTexCoord0.xy;
+}
+)";
+
+const char* OBSTACLE_FRAGMENT_SHADER = R"(
+#version 120
+uniform sampler2D texture;
+uniform bool useTexture;
+varying vec2 texCoord;
+varying vec4 litColor;
+
+void main() {
+    gl_FragColor = useTexture ? litColor * texture2D(texture, texCoord) : litColor;
+}
+)";
+
+// background stars, generated once into a vertex buffer. twinkling is done
+// in a vertex shader from a per-star phase so the cpu does nothing per frame
+const GLuint STAR_PHASE_ATTRIB = 6;
+const int STAR_FLOATS = 4; // x y z phase
+int starCount = 500;
+bool starTwinkle = true;
+std::vector<float> starVertices;
+GLuint starBuffer = 0;
+GLuint starProgram = 0;
+GLint starTimeLocation = -1;
+std::chrono::steady_clock::time_point startTime;
+
+const char* STAR_VERTEX_SHADER = R"(
+#version 120
+attribute float starPhase;
+uniform float time;
+varying vec4 starColor;
+
+void main() {
+    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+
+    // every star gets its own speed and offset out of its phase
+    float speed = 1.5 + 3.0 * fract(starPhase * 7.13);
+    float brightness = 0.6 + 0.4 * sin(time * speed + starPhase * 6.2831853);
+
+    // blueish white?
+    starColor = vec4(vec3(0.8, 0.8, 1.0) * brightness, 1.0);
+}
+)";
+
+const char* STAR_FRAGMENT_SHADER = R"(
+#version 120
+varying vec4 starColor;
+
+void main() {
+    gl_FragColor = starColor;
+}
+)";
+
+// core profile renderer (--core-profile). light 0 is set up in init() under
+// an identity modelview, so its direction is fixed in eye space. every
+// object ends up with the rocket base's 0.7 grey as ambient and diffuse, the
+// fixed function path keeps that glMaterial from the first frame on
+bool coreProfile = false;
+CoreRenderer coreRenderer;
+Mat4 viewMatrix;
+const CoreLight SCENE_LIGHT = {
+    { -1.0f, 1.0f, 1.0f, 0.0f }, { 0.2f, 0.2f, 0.2f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f },
+};
+const float SCENE_AMBIENT[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
+const CoreMaterial SCENE_MATERIAL = {
+    { 0.7f, 0.7f, 0.7f, 1.0f }, { 0.7f, 0.7f, 0.7f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.0f,
+};
+Mesh rocketBaseMesh; // the two base triangles, drawn with glBegin otherwise
+GLuint starVertexArray = 0;
+GLint starTwinkleLocation = -1;
+
+// the instanced obstacle shader for the core profile, same spin as above
+const char* OBSTACLE_CORE_VERTEX_SHADER = R"(
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+layout(location = 6) in vec4 instancePosRadius;
+layout(location = 7) in float instanceSpin;
+out vec3 eyePosition;
+out vec3 eyeNormal;
+out vec2 surfaceTexCoord;
+
+vec3 spin(vec3 v, float degrees) {
+    vec3 axis = vec3(0.70710678, 0.70710678, 0.0);
+    float c = cos(radians(degrees));
+    float s = sin(radians(degrees));
+    return v * c + cross(axis, v) * s + axis * dot(axis, v) * (1.0 - c);
+}
+
+void main() {
+    vec4 eye = modelView * vec4(spin(position * instancePosRadius.w, instanceSpin) + instancePosRadius.xyz, 1.0);
+    eyePosition = eye.xyz;
+    eyeNormal = mat3(modelView) * spin(normal, instanceSpin);
+    surfaceTexCoord = texCoord;
+    gl_Position = projection * eye;
+}
+)";
+
+const char* STAR_CORE_VERTEX_SHADER = R"(
+layout(location = 0) in vec3 position;
+layout(location = 6) in float starPhase;
+uniform float time;
+uniform bool twinkle;
+out vec4 starColor;
+
+void main() {
+    gl_Position = projection * modelView * vec4(position, 1.0);
+
+    float brightness = 1.0;
+    if (twinkle) {
+        float speed = 1.5 + 3.0 * fract(starPhase * 7.13);
+        brightness = 0.6 + 0.4 * sin(time * speed + starPhase * 6.2831853);
+    }
+    starColor = vec4(vec3(0.8, 0.8, 1.0) * brightness, 1.0);
+}
+)";
+
+// round points, the core profile has no GL_POINT_SMOOTH
+const char* STAR_CORE_FRAGMENT_SHADER = R"(
+in vec4 starColor;
+out vec4 fragColor;
+
+void main() {
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    if (dot(offset, offset) > 1.0) discard;
+    fragColor = starColor;
+}
+)";
+
+// frame time benchmark
+int benchFrames = 0;
+std::vector<double> benchFrameTimes;
+std::chrono::steady_clock::time_point benchFrameStart;
+
+// input recording. every gameplay input is stored with the tick it happened
+// before, replaying them into the same seed gives the exact same game.
+// file: "RKRP", u32 version, u64 seed, then 6 byte events (u32 tick, u8 type,
+// u8 code), all little endian. INPUT_END closes the file and is followed by
+// the u32 state checksum at that tick
+enum InputType {
+    INPUT_KEY = 1,     // code is the ascii key
+    INPUT_SPECIAL = 2, // code is the GLUT_KEY_* value
+    INPUT_PAUSE = 3,   // mouse click
+    INPUT_END = 255,
+};
+struct InputEvent {
+    uint32_t tick;
+    uint8_t type;
+    uint8_t code;
+};
+const char REPLAY_MAGIC[4] = { 'R', 'K', 'R', 'P' };
+const uint32_t REPLAY_VERSION = 1;
+uint32_t simTick = 0; // ticks since the program started
+FILE* recordFile = nullptr;
+
+// profiler overlay and trace export
+bool showProfiler = false;
+const char* traceFilename = nullptr;
+
+// offscreen rendering (egl, no window). glut must not be called in this mode
+bool offscreen = false;
+int offscreenFrames = 0;
+const char* dumpFramesPrefix = nullptr;
+GetProcAddressFn glProcSource = glutProcAddress;
+
+// headless mode runs the simulation without glut (benchmarks, soak tests)
+bool headless = false;
+
 // camera parameters
 float cameraDistance = 5.0f;
 float cameraHeight = 2.0f;
 float cameraAngle = 0.0f;
 
 
-GLuint loadTexture(const char* filename);
-void init();
+bool init();
 void drawEarth();
 void drawRocket();
-void drawObstacle(Obstacle& obstacle);
+void drawObstacle(int index);
 void drawStars();
+void initStars();
 void reshape(int width, int height);
-void timer(int value);
+void idle();
+void tickSimulation();
+void savePreviousState();
+void updateRateCounters();
+void recordBenchFrame();
+void printRenderSettings();
+void initObstacleInstancing();
+void drawObstaclesInstanced();
+float lerp(float from, float to, float alpha);
+void runHeadless(long long ticks);
 void keyboard(unsigned char key, int x, int y);
 void mouse(int key, int state, int x, int y);
 void specialKeys(int key, int x, int y);
@@ -96,85 +484,260 @@ void updateGame();
 void checkCollisions();
 void display();
 void addObstacle();
+void runCollisionBenchmark();
+bool findObstacleHit(float x, float y, float z, float radius, int ignore, int& hit);
+template <typename Visit>
+void forEachOverlappingPair(const SpatialGrid2D& grid, const float* x, const float* y, const float* z, const float* radius,
+    int count, float maxRadius, Visit visit);
 void resetGame();
+void seedRandomStreams(uint64_t seed);
+bool applyInput(int type, int code);
+void gameInput(int type, int code);
+bool startRecording(const char* filename);
+void finishRecording();
+bool runReplay(const char* filename, long long extraTicks);
+uint32_t stateChecksum();
+void drawProfilerOverlay();
+void drawTextOverlay();
+bool initCoreRendering();
+void writeTrace();
+bool runOffscreen(int frames);
+void reportFirstFrame();
+void printLodStats(int frames);
+int cullObstacles();
+int pickSphereLevel(const SphereLod& lod, float x, float y, float z, float radius);
 
 int main(int argc, char** argv) {
+    obstacleGrid.init(-DESPAWN_DISTANCE, GRID_MIN_Y, DESPAWN_DISTANCE, GRID_MAX_Y, GRID_CELL_SIZE, MAX_OBSTACLES);
+
+    long long headlessTicks = 0;
+    const char* recordFilename = nullptr;
+    const char* replayFilename = nullptr;
+    gameSeed = static_cast<uint64_t>(time(0));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            headless = true;
+            headlessTicks = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc) {
+            benchFrames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--legacy-geometry") == 0) {
+            legacyGeometry = true;
+        }
+        else if (strcmp(argv[i], "--no-lod") == 0) {
+            earthLod.enabled = false;
+            obstacleLod.enabled = false;
+        }
+        else if (strcmp(argv[i], "--no-culling") == 0) {
+            frustumCulling = false;
+        }
+        else if (strcmp(argv[i], "--no-instancing") == 0) {
+            useInstancing = false;
+        }
+        else if (strcmp(argv[i], "--core-profile") == 0) {
+            coreProfile = true;
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            gameSeed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordFilename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayFilename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceFilename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--offscreen") == 0 && i + 1 < argc) {
+            offscreenFrames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc) {
+            dumpFramesPrefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sync-textures") == 0) {
+            syncTextures = true;
+        }
+        else if (strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc) {
+            const char* filter = argv[++i];
+            textureCache.sampling.mipmaps = strcmp(filter, "off") != 0;
+            textureCache.sampling.mipFilter = strcmp(filter, "kaiser") == 0 ? MIP_FILTER_KAISER : MIP_FILTER_BOX;
+        }
+        else if (strcmp(argv[i], "--anisotropy") == 0 && i + 1 < argc) {
+            textureCache.sampling.anisotropy = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--no-compressed") == 0) {
+            textureCache.sampling.compressed = false;
+        }
+        else if (strcmp(argv[i], "--stream-textures") == 0) {
+            textureCache.streaming = true;
+        }
+        else if (strcmp(argv[i], "--upload-budget") == 0 && i + 1 < argc) {
+            textureCache.streamBudgetBytes = static_cast<size_t>(std::max(1, atoi(argv[++i]))) * 1024;
+        }
+        else if (strcmp(argv[i], "--stars") == 0 && i + 1 < argc) {
+            starCount = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--no-twinkle") == 0) {
+            starTwinkle = false;
+        }
+        else if (strcmp(argv[i], "--bench-collisions") == 0) {
+            runCollisionBenchmark();
+            return 0;
+        }
+    }
+
+    if (coreProfile && legacyGeometry) {
+        std::cout << "--core-profile has no glu quadrics, ignoring --legacy-geometry" << std::endl;
+        legacyGeometry = false;
+    }
+
+    if (traceFilename) {
+        profiler.enabled = true;
+        profiler.recordTrace = true;
+        atexit(writeTrace);
+    }
+
+    if (replayFilename) {
+        headless = true;
+        return runReplay(replayFilename, headlessTicks) ? 0 : 1;
+    }
+
+    seedRandomStreams(gameSeed);
+
+    if (recordFilename && !startRecording(recordFilename)) {
+        return 1;
+    }
+
+    if (headless) {
+        runHeadless(headlessTicks);
+        return 0;
+    }
+
+    if (offscreenFrames > 0) {
+        return runOffscreen(offscreenFrames) ? 0 : 1;
+    }
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
     glutInitWindowSize(SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (coreProfile) {
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+    }
     glutCreateWindow("Rocket Game");
 
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
     glutKeyboardFunc(keyboard);
     glutSpecialFunc(specialKeys);
-    glutTimerFunc(16, timer, 0);
+    glutIdleFunc(idle);
     glutMouseFunc(mouse);
 
-    init();
-
-    glutMainLoop();
-}
-
-GLuint loadTexture(const char* filename) {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, STBI_rgb_alpha);
-
-    if (!image) {
-        std::cout << "Failed to load texture: " << filename << std::endl;
-        return 0;
-    }
-
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-
-    // texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    startTime = std::chrono::steady_clock::now();
+    if (!init()) return 1;
 
-    // image data
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    lastFrameTime = std::chrono::steady_clock::now();
+    rateWindowStart = lastFrameTime;
 
-    // free the image from memory
-    stbi_image_free(image);
-
-    return textureID;
+    glutMainLoop();
 }
 
-void init() {
-    // lighting
-    GLfloat ambient[] = { 0.2f, 0.2f, 0.2f, 1.0f };
-    GLfloat diffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    GLfloat specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    GLfloat position[] = { -1.0f, 1.0f, 1.0f, 0.0f };
-
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-    glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuse);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, specular);
-    glLightfv(GL_LIGHT0, GL_POSITION, position);
+// false if --core-profile could not get its renderer going
+bool init() {
+    loadGLExtensions(glProcSource);
 
     // depth testing
     glEnable(GL_DEPTH_TEST);
 
-    // enable texture
-    glEnable(GL_TEXTURE_2D);
+    // the core profile has its light in SCENE_LIGHT and always textures
+    if (!coreProfile) {
+        // lighting
+        GLfloat ambient[] = { 0.2f, 0.2f, 0.2f, 1.0f };
+        GLfloat diffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        GLfloat specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        GLfloat position[] = { -1.0f, 1.0f, 1.0f, 0.0f };
+
+        glEnable(GL_LIGHTING);
+        glEnable(GL_LIGHT0);
+        glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
+        glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuse);
+        glLightfv(GL_LIGHT0, GL_SPECULAR, specular);
+        glLightfv(GL_LIGHT0, GL_POSITION, position);
+
+        // enable texture
+        glEnable(GL_TEXTURE_2D);
 
-    // load textures
-    earthTexture = loadTexture("earth.jpg");
-    rocketTexture = loadTexture("rocket.jpg");
-    obstacleTexture = loadTexture("rock.jpg");
-    starTexture = loadTexture("space.jpg");
+        // cached meshes are unit sized and scaled in place, keep the normals unit length
+        glEnable(GL_NORMALIZE);
+    }
+    else if (!coreRenderer.init()) {
+        return false;
+    }
 
-    // initialize random seed which makes the spawning random
-    srand(static_cast<unsigned int>(time(0)));
+    earthLod.init(meshCache, 32);
+    obstacleLod.init(meshCache, 12);
+    initObstacleInstancing();
+    initStars();
+    if (coreProfile && !initCoreRendering()) return false;
+
+    // load textures, decoded once and then mapped from their .texcache files
+    if (syncTextures) {
+        earthTexture = textureCache.load("earth.jpg");
+        rocketTexture = textureCache.load("rocket.jpg");
+        obstacleTexture = textureCache.load("rock.jpg");
+        starTexture = textureCache.load("space.jpg");
+        textureCache.printStats();
+    }
+    else {
+        earthTexture = textureCache.loadAsync("earth.jpg");
+        rocketTexture = textureCache.loadAsync("rocket.jpg");
+        obstacleTexture = textureCache.loadAsync("rock.jpg");
+        starTexture = textureCache.loadAsync("space.jpg");
+    }
 
     // reset game
     resetGame();
+    return true;
+}
+
+// the pieces of the scene that have no mesh or program of their own yet:
+// the rocket base triangles and the stars
+bool initCoreRendering() {
+    addMeshVertex(rocketBaseMesh, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0, 0);    // Base center
+    addMeshVertex(rocketBaseMesh, 0.15f, 0.0f, -0.1f, 0.0f, 0.0f, 1.0f, 0, 1);  // Right tip
+    addMeshVertex(rocketBaseMesh, 0.0f, 0.0f, -0.2f, 0.0f, 0.0f, 1.0f, 1, 0);   // Back center
+    addMeshVertex(rocketBaseMesh, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0, 0);
+    addMeshVertex(rocketBaseMesh, -0.15f, 0.0f, -0.1f, 0.0f, 0.0f, 1.0f, 0, 1); // Left tip
+    addMeshVertex(rocketBaseMesh, 0.0f, 0.0f, -0.2f, 0.0f, 0.0f, 1.0f, 1, 0);
+    rocketBaseMesh.indices = { 0, 1, 2, 3, 4, 5 };
+    uploadMesh(rocketBaseMesh);
+
+    starProgram = coreRenderer.buildProgram(STAR_CORE_VERTEX_SHADER, STAR_CORE_FRAGMENT_SHADER);
+    if (!starProgram) return false;
+    starTimeLocation = glext.getUniformLocation(starProgram, "time");
+    starTwinkleLocation = glext.getUniformLocation(starProgram, "twinkle");
+
+    const GLsizei stride = STAR_FLOATS * sizeof(float);
+    const char* base = nullptr;
+    glext.genVertexArrays(1, &starVertexArray);
+    glext.bindVertexArray(starVertexArray);
+    glext.bindBuffer(GL_ARRAY_BUFFER, starBuffer);
+    glext.vertexAttribPointer(MESH_POSITION_ATTRIB, 3, GL_FLOAT, GL_FALSE, stride, base);
+    glext.vertexAttribPointer(STAR_PHASE_ATTRIB, 1, GL_FLOAT, GL_FALSE, stride, base + 3 * sizeof(float));
+    glext.enableVertexAttribArray(MESH_POSITION_ATTRIB);
+    glext.enableVertexAttribArray(STAR_PHASE_ATTRIB);
+    glext.bindVertexArray(0);
+    glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+// the seed is printed so any run can be repeated with --seed
+void seedRandomStreams(uint64_t seed) {
+    std::cout << "seed: " << seed << std::endl;
+    spawnRandom.seed(seed, STREAM_SPAWN);
+    starRandom.seed(seed, STREAM_STARS);
 }
 
 // to reset all of our variables
@@ -188,6 +751,7 @@ void resetGame() {
     rocket.isAlive = true;
 
     obstacles.clear();
+    obstacleGrid.clear();
 
     gameTime = 0.0f;
     gameOver = false;
@@ -199,70 +763,119 @@ void resetGame() {
     for (int i = 0; i < 2; i++) {
         addObstacle();
     }
+
+    // nothing to interpolate from after a reset
+    savePreviousState();
 }
 
 // add an obstacle to our view
 void addObstacle() {
-    Obstacle obstacle;
+    int i = obstacles.acquire();
+    if (i < 0) return;
 
     // decide if obstacle comes from left or right side, but it doesnt work :"(
-    bool fromLeft = (rand() % 2 == 0);
+    bool fromLeft = (spawnRandom.below(2) == 0);
 
-    obstacle.z = rocket.z; // it stays in the same layer as the rocket (unity vibes)
+    obstacles.z[i] = rocket.z; // it stays in the same layer as the rocket (unity vibes)
 
     if (fromLeft) {
-        obstacle.x = -8.0f; // left
+        obstacles.x[i] = -8.0f; // left
     }
     else {
-        obstacle.x = 8.0f;  // right
+        obstacles.x[i] = 8.0f;  // right
     }
 
-    obstacle.y = 0.5f + static_cast<float>(rand() % 40) / 10.0f; // random height
+    obstacles.y[i] = 0.5f + static_cast<float>(spawnRandom.below(40)) / 10.0f; // random height
+
+    obstacles.radius[i] = 0.3f + static_cast<float>(spawnRandom.below(20)) / 500.0f;
+    obstacles.rotationSpeed[i] = static_cast<float>(spawnRandom.below(100)) / 100.0f;
+    obstacles.speed[i] = static_cast<float>(spawnRandom.below(5));
 
-    obstacle.radius = 0.3f + static_cast<float>(rand() % 20) / 500.0f;
-    obstacle.rotationSpeed = static_cast<float>(rand() % 100) / 100.0f;
-    obstacle.speed = static_cast<float>(rand() % 5);
+    obstacles.prevX[i] = obstacles.x[i];
+    obstacles.prevY[i] = obstacles.y[i];
 
-    obstacles.push_back(obstacle);
+    obstacles.maxRadius = std::max(obstacles.maxRadius, obstacles.radius[i]);
+    obstacleGrid.insert(i, obstacles.x[i], obstacles.y[i]);
 }
 
 // keyboard functions ----------------------
+// everything that changes the game goes through here, so it can be recorded
+// and replayed. returns false if the input did nothing
+bool applyInput(int type, int code) {
+    if (type == INPUT_KEY) {
+        switch (code) {
+        case 'w':
+        case 'W':
+        case ' ':
+            // up
+            rocket.velocity += 0.02f;
+            return true;
+        case 's':
+        case 'S':
+            // down
+            rocket.velocity -= 0.01f;
+            return true;
+        case 'r':
+        case 'R':
+            // reset game if it is over only
+            if (gameOver) {
+                resetGame();
+                return true;
+            }
+            return false;
+        }
+    }
+    else if (type == INPUT_SPECIAL) {
+        switch (code) {
+        case GLUT_KEY_UP:
+            rocket.velocity += 0.02f;
+            return true;
+        case GLUT_KEY_DOWN:
+            rocket.velocity -= 0.01f;
+            return true;
+        }
+    }
+    else if (type == INPUT_PAUSE) {
+        gamePaused = !gamePaused;
+        return true;
+    }
+    return false;
+}
+void gameInput(int type, int code) {
+    if (applyInput(type, code) && recordFile) {
+        uint8_t event[6] = {
+            static_cast<uint8_t>(simTick), static_cast<uint8_t>(simTick >> 8),
+            static_cast<uint8_t>(simTick >> 16), static_cast<uint8_t>(simTick >> 24),
+            static_cast<uint8_t>(type), static_cast<uint8_t>(code),
+        };
+        fwrite(event, 1, sizeof(event), recordFile);
+    }
+}
 void keyboard(unsigned char key, int x, int y) {
     switch (key) {
-    case 'w':
-    case 'W':
-    case ' ':
-        // up
-        rocket.velocity += 0.02f;
-        break;
-    case 's':
-    case 'S':
-        // down
-        rocket.velocity -= 0.01f;
-        break;
-    case 'r':
-    case 'R':
-        // reset game if it is over only
-        if (gameOver)
-            resetGame();
-        break;
     case 27:  // ESC key
         exit(0);
         break;
+    case 'p':
+    case 'P':
+        showProfiler = !showProfiler;
+        profiler.enabled = showProfiler || traceFilename;
+        break;
+    default:
+        gameInput(INPUT_KEY, key);
+        break;
     }
 }
 void mouse(int button, int state, int x, int y)
 {
     if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN)
-        gamePaused = !gamePaused;
+        gameInput(INPUT_PAUSE, 0);
 }
 void specialKeys(int key, int x, int y) {
     switch (key) {
     case GLUT_KEY_UP:
-        rocket.velocity += 0.02f;
-        break;
     case GLUT_KEY_DOWN:
-        rocket.velocity -= 0.01f;
+        gameInput(INPUT_SPECIAL, key);
         break;
     case GLUT_KEY_F11:
         isFullscreen = !isFullscreen;
@@ -278,6 +891,155 @@ void specialKeys(int key, int x, int y) {
 }
 // -----------------------------------------
 
+// recording & replay ----------------------
+void writeU32(FILE* file, uint32_t value) {
+    uint8_t bytes[4] = {
+        static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8),
+        static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 24),
+    };
+    fwrite(bytes, 1, sizeof(bytes), file);
+}
+bool readU32(FILE* file, uint32_t& value) {
+    uint8_t bytes[4];
+    if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) return false;
+    value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    return true;
+}
+bool startRecording(const char* filename) {
+    recordFile = fopen(filename, "wb");
+    if (!recordFile) {
+        std::cout << "Failed to open recording: " << filename << std::endl;
+        return false;
+    }
+
+    fwrite(REPLAY_MAGIC, 1, sizeof(REPLAY_MAGIC), recordFile);
+    writeU32(recordFile, REPLAY_VERSION);
+    writeU32(recordFile, static_cast<uint32_t>(gameSeed));
+    writeU32(recordFile, static_cast<uint32_t>(gameSeed >> 32));
+
+    // glut leaves through exit(), so close the file from there
+    atexit(finishRecording);
+    return true;
+}
+void finishRecording() {
+    if (!recordFile) return;
+
+    uint32_t checksum = stateChecksum();
+    uint8_t end[6] = {
+        static_cast<uint8_t>(simTick), static_cast<uint8_t>(simTick >> 8),
+        static_cast<uint8_t>(simTick >> 16), static_cast<uint8_t>(simTick >> 24),
+        INPUT_END, 0,
+    };
+    fwrite(end, 1, sizeof(end), recordFile);
+    writeU32(recordFile, checksum);
+    fclose(recordFile);
+    recordFile = nullptr;
+
+    std::cout << "recorded " << simTick << " ticks, checksum " << checksum << std::endl;
+}
+// fnv-1a over everything the simulation owns, equal checksums mean equal games
+uint32_t stateChecksum() {
+    uint32_t hash = 2166136261u;
+    auto mix = [&](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+    };
+    mix(&simTick, sizeof(simTick));
+    mix(&rocket.y, sizeof(rocket.y));
+    mix(&rocket.velocity, sizeof(rocket.velocity));
+    mix(&rocket.isAlive, sizeof(rocket.isAlive));
+    mix(&gameTime, sizeof(gameTime));
+    mix(&gameSpeed, sizeof(gameSpeed));
+    mix(&gameOver, sizeof(gameOver));
+    mix(&gamePaused, sizeof(gamePaused));
+    mix(&obstacles.count, sizeof(obstacles.count));
+    mix(obstacles.x, obstacles.count * sizeof(float));
+    mix(obstacles.y, obstacles.count * sizeof(float));
+    mix(obstacles.radius, obstacles.count * sizeof(float));
+    mix(obstacles.rotationSpeed, obstacles.count * sizeof(float));
+    return hash;
+}
+// runs a recording through the headless simulation as fast as possible.
+// without an end marker (crashed session) it stops at the last input plus
+// extraTicks. returns false if the file is broken or the end state differs
+bool runReplay(const char* filename, long long extraTicks) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        std::cout << "Failed to open replay: " << filename << std::endl;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0, seedLow = 0, seedHigh = 0;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 ||
+        !readU32(file, version) || version != REPLAY_VERSION || !readU32(file, seedLow) || !readU32(file, seedHigh)) {
+        std::cout << "Not a replay file: " << filename << std::endl;
+        fclose(file);
+        return false;
+    }
+
+    std::vector<InputEvent> events;
+    bool hasEnd = false;
+    uint32_t endTick = 0, expectedChecksum = 0;
+    uint8_t record[6];
+    while (fread(record, 1, sizeof(record), file) == sizeof(record)) {
+        InputEvent event;
+        event.tick = record[0] | (record[1] << 8) | (record[2] << 16) | (static_cast<uint32_t>(record[3]) << 24);
+        event.type = record[4];
+        event.code = record[5];
+        if (event.type == INPUT_END) {
+            hasEnd = readU32(file, expectedChecksum);
+            endTick = event.tick;
+            break;
+        }
+        events.push_back(event);
+    }
+    fclose(file);
+
+    if (!hasEnd) {
+        endTick = static_cast<uint32_t>((events.empty() ? 0 : events.back().tick) + extraTicks);
+    }
+
+    gameSeed = seedLow | (static_cast<uint64_t>(seedHigh) << 32);
+    seedRandomStreams(gameSeed);
+    resetGame();
+
+    // same order as the live game: inputs that came in before a tick, then the tick
+    size_t nextEvent = 0;
+    long long gameOvers = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (simTick < endTick) {
+        while (nextEvent < events.size() && events[nextEvent].tick == simTick) {
+            applyInput(events[nextEvent].type, events[nextEvent].code);
+            nextEvent++;
+        }
+        bool wasOver = gameOver;
+        tickSimulation();
+        if (gameOver && !wasOver) gameOvers++;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    uint32_t checksum = stateChecksum();
+    std::cout << "inputs:      " << events.size() << "\n";
+    std::cout << "ticks:       " << endTick << "\n";
+    std::cout << "seconds:     " << seconds << "\n";
+    std::cout << "ticks/sec:   " << (seconds > 0.0 ? endTick / seconds : 0.0) << "\n";
+    std::cout << "game overs:  " << gameOvers << "\n";
+    std::cout << "checksum:    " << checksum;
+    if (hasEnd && checksum == expectedChecksum) {
+        std::cout << " (matches recording)";
+    }
+    else if (hasEnd) {
+        std::cout << " (MISMATCH, recorded " << expectedChecksum << ")";
+    }
+    std::cout << std::endl;
+    return !hasEnd || checksum == expectedChecksum;
+}
+// -----------------------------------------
+
 // update functions ------------------------
 void keepRocketWithinBounds()
 {
@@ -292,47 +1054,111 @@ void keepRocketWithinBounds()
 }
 void moveObstacleForward()
 {
-    for (auto& obstacle : obstacles) {
+    PROFILE_SCOPE("moveObstacleForward");
+
+    // every obstacle moves every tick, so re-link them all on the way
+    obstacleGrid.clear();
+
+    for (int i = 0; i < obstacles.count;) {
+        float& x = obstacles.x[i];
+
         // move forward
-        obstacle.x += gameSpeed * 2.0f;
+        x += gameSpeed * 2.0f;
 
-        if (obstacle.x < 0) {
-            obstacle.x += gameSpeed * 0.5f; // move right if on left side
+        if (x < 0) {
+            x += gameSpeed * 0.5f; // move right if on left side
         }
-        else if (obstacle.x > 0) {
-            obstacle.x -= gameSpeed * 0.5f; // move left if on right side
+        else if (x > 0) {
+            x -= gameSpeed * 0.5f; // move left if on right side
         }
+
+        // off screen, give the slot back (the last obstacle moves into i)
+        if (fabsf(x) > DESPAWN_DISTANCE) {
+            obstacles.release(i);
+            continue;
+        }
+
+        obstacleGrid.insert(i, x, obstacles.y[i]);
+        i++;
     }
 }
 void spawnObstaclesByChance()
 {
+    PROFILE_SCOPE("spawnObstaclesByChance");
+
     // so it does not spawn every frame
     int spawnChance = 3;
 
-    if (rand() % 100 < spawnChance) {
+    if (spawnRandom.below(100) < static_cast<uint32_t>(spawnChance)) {
         addObstacle();
     }
 }
 void checkCollisions() {
-    if (!rocket.isAlive) return;
+    PROFILE_SCOPE("checkCollisions");
 
-    for (auto& obstacle : obstacles) {
-        float dx = rocket.x - obstacle.x;
-        float dy = rocket.y - obstacle.y;
-        float dz = rocket.z - obstacle.z;
-        float distance = sqrt(dx * dx + dy * dy + dz * dz);
+    if (!rocket.isAlive) return;
 
-        if (distance < (rocket.radius + obstacle.radius)) {
-            // collision detected!
-            rocket.isAlive = false;
-            gameOver = true;
+    int hit;
+    if (findObstacleHit(rocket.x, rocket.y, rocket.z, rocket.radius, -1, hit)) {
+        // collision detected!
+        rocket.isAlive = false;
+        gameOver = true;
+        if (!headless)
             std::cout << "Game Over!\n"; // make sure it is working 
-            break;
-        }
+    }
+}
+// narrow phase on the grid candidates only. they are gathered into small
+// x/y/z/radius batches so sweepSpheres() can test several at once
+bool findObstacleHit(float x, float y, float z, float radius, int ignore, int& hit) {
+    const int BATCH = 32;
+    float batchX[BATCH], batchY[BATCH], batchZ[BATCH], batchRadius[BATCH];
+    int batchIndex[BATCH];
+    int count = 0;
+
+    auto sweepBatch = [&]() {
+        int found = sweepSpheres(batchX, batchY, batchZ, batchRadius, count, x, y, z, radius);
+        count = 0;
+        if (found < 0) return false;
+        hit = batchIndex[found];
+        return true;
+    };
+
+    bool found = obstacleGrid.query(x, y, radius + obstacles.maxRadius, [&](int i) {
+        if (i == ignore) return false;
+
+        batchX[count] = obstacles.x[i];
+        batchY[count] = obstacles.y[i];
+        batchZ[count] = obstacles.z[i];
+        batchRadius[count] = obstacles.radius[i];
+        batchIndex[count++] = i;
+        return count == BATCH && sweepBatch();
+    });
+    return found || (count > 0 && sweepBatch());
+}
+// obstacle vs obstacle through a grid built over the same arrays, each
+// touching pair once (a < b). for the game that is obstacleGrid and obstacles
+template <typename Visit>
+void forEachOverlappingPair(const SpatialGrid2D& grid, const float* x, const float* y, const float* z, const float* radius,
+    int count, float maxRadius, Visit visit) {
+    for (int a = 0; a < count; a++) {
+        grid.query(x[a], y[a], radius[a] + maxRadius, [&](int b) {
+            if (b <= a) return false;
+
+            float dx = x[a] - x[b];
+            float dy = y[a] - y[b];
+            float dz = z[a] - z[b];
+            float reach = radius[a] + radius[b];
+            if (dx * dx + dy * dy + dz * dz < reach * reach) {
+                visit(a, b);
+            }
+            return false;
+        });
     }
 }
 // -----------------------------------------
 void updateGame() {
+    PROFILE_SCOPE("updateGame");
+
     // so every thing stops when game is over
     if (gameOver || gamePaused) return;
 
@@ -356,12 +1182,28 @@ void updateGame() {
 
 // drawing functions -----------------------
 void drawEarth() {
+    PROFILE_SCOPE("drawEarth");
+
+    // each time update is called rotate earth
+    float angle = earthRotationAngle;
+    if (angle < prevEarthRotationAngle) {
+        angle += 360.0f; // wrapped around this tick
+    }
+    angle = lerp(prevEarthRotationAngle, angle, renderAlpha);
+
+    if (coreProfile) {
+        int level = pickSphereLevel(earthLod, 0.0f, -20.0f, 0.0f, 20.0f);
+        Mat4 model = multiply(translationMatrix(0.0f, -20.0f, 0.0f),
+            multiply(rotationMatrix(angle, 0.0f, 0.0f, 1.0f), scaleMatrix(20.0f)));
+        coreRenderer.drawMesh(earthLod.mesh(level), multiply(viewMatrix, model), SCENE_MATERIAL, earthTexture);
+        earthLod.countDrawn(level);
+        return;
+    }
+
     glPushMatrix();
 
     glTranslatef(0.0f, -20.0f, 0.0f);
-
-    // each time update is called rotate earth
-    glRotatef(earthRotationAngle, 0.0f, 0.0f, 1.0f);
+    glRotatef(angle, 0.0f, 0.0f, 1.0f);
 
     // texture
     if (earthTexture) {
@@ -369,19 +1211,39 @@ void drawEarth() {
     }
 
     // sphere
-    GLUquadricObj* earth = gluNewQuadric();
-    gluQuadricTexture(earth, GL_TRUE);
-    gluSphere(earth, 20.0f, 32, 32);
-    gluDeleteQuadric(earth);
+    if (legacyGeometry) {
+        GLUquadricObj* earth = gluNewQuadric();
+        gluQuadricTexture(earth, GL_TRUE);
+        gluSphere(earth, 20.0f, 32, 32);
+        gluDeleteQuadric(earth);
+    }
+    else {
+        int level = pickSphereLevel(earthLod, 0.0f, -20.0f, 0.0f, 20.0f);
+        glScalef(20.0f, 20.0f, 20.0f);
+        drawMesh(earthLod.mesh(level));
+        earthLod.countDrawn(level);
+    }
 
     glPopMatrix();
 }
 void drawRocket() {
     if (!rocket.isAlive) return;
+    PROFILE_SCOPE("drawRocket");
+
+    if (coreProfile) {
+        Mat4 model = multiply(viewMatrix, multiply(
+            translationMatrix(rocket.x, lerp(rocket.prevY, rocket.y, renderAlpha), rocket.z),
+            rotationMatrix(-90.0f, 1.0f, 0.0f, 0.0f)));
+        coreRenderer.drawMesh(meshCache.cylinder(0.1f, 0.1f, 0.4f, 12, 12), model, SCENE_MATERIAL, rocketTexture);
+        coreRenderer.drawMesh(meshCache.cylinder(0.1f, 0.0f, 0.2f, 12, 12),
+            multiply(model, translationMatrix(0.0f, 0.0f, 0.4f)), SCENE_MATERIAL, rocketTexture);
+        coreRenderer.drawMesh(rocketBaseMesh, model, SCENE_MATERIAL, rocketTexture);
+        return;
+    }
 
     glPushMatrix();
 
-    glTranslatef(rocket.x, rocket.y, rocket.z);
+    glTranslatef(rocket.x, lerp(rocket.prevY, rocket.y, renderAlpha), rocket.z);
 
     glRotatef(-90.0f, 1.0f, 0.0f, 0.0f);
 
@@ -390,17 +1252,28 @@ void drawRocket() {
     }
 
     // rocket body (cylinder)
-    GLUquadricObj* body = gluNewQuadric();
-    gluQuadricTexture(body, GL_TRUE);
-    gluCylinder(body, 0.1f, 0.1f, 0.4f, 12, 12);
+    if (legacyGeometry) {
+        GLUquadricObj* body = gluNewQuadric();
+        gluQuadricTexture(body, GL_TRUE);
+        gluCylinder(body, 0.1f, 0.1f, 0.4f, 12, 12);
+        gluDeleteQuadric(body);
+    }
+    else {
+        drawMesh(meshCache.cylinder(0.1f, 0.1f, 0.4f, 12, 12));
+    }
 
     // rocket cone
     glPushMatrix();
     glTranslatef(0.0f, 0.0f, 0.4f);  // top of cylinder
-    GLUquadricObj* nose = gluNewQuadric();
-    gluQuadricTexture(nose, GL_TRUE);
-    gluCylinder(nose, 0.1f, 0.0f, 0.2f, 12, 12);
-    gluDeleteQuadric(nose);
+    if (legacyGeometry) {
+        GLUquadricObj* nose = gluNewQuadric();
+        gluQuadricTexture(nose, GL_TRUE);
+        gluCylinder(nose, 0.1f, 0.0f, 0.2f, 12, 12);
+        gluDeleteQuadric(nose);
+    }
+    else {
+        drawMesh(meshCache.cylinder(0.1f, 0.0f, 0.2f, 12, 12));
+    }
     glPopMatrix();
 
     // rocket base
@@ -421,69 +1294,273 @@ void drawRocket() {
     glTexCoord2f(1, 0); glVertex3f(0.0f, 0.0f, -0.2f);    // Back center
     glEnd();
 
-    gluDeleteQuadric(body);
     glPopMatrix();
 }
-void drawObstacle(Obstacle& obstacle) {
+void drawObstacle(int index) {
+    float radius = obstacles.radius[index];
+    float spin = lerp(prevGameTime, gameTime, renderAlpha) * 50.0f * obstacles.rotationSpeed[index];
+
+    if (coreProfile) {
+        int level = pickSphereLevel(obstacleLod, obstacleDrawX[index], obstacles.y[index], obstacles.z[index], radius);
+        Mat4 model = multiply(translationMatrix(obstacleDrawX[index], obstacles.y[index], obstacles.z[index]),
+            multiply(rotationMatrix(spin, 1.0f, 1.0f, 0.0f), scaleMatrix(radius)));
+        coreRenderer.drawMesh(obstacleLod.mesh(level), multiply(viewMatrix, model), SCENE_MATERIAL, obstacleTexture);
+        obstacleLod.countDrawn(level);
+        return;
+    }
+
     glPushMatrix();
-    glTranslatef(obstacle.x, obstacle.y, obstacle.z);
-    glRotatef(gameTime * 50.0f * obstacle.rotationSpeed, 1.0f, 1.0f, 0.0f);
+    glTranslatef(obstacleDrawX[index], obstacles.y[index], obstacles.z[index]);
+    glRotatef(spin, 1.0f, 1.0f, 0.0f);
+
+    if (legacyGeometry) {
+        // a temporary quadric for texture coordinates
+        GLUquadricObj* sphere = gluNewQuadric();
+        gluQuadricTexture(sphere, GL_TRUE);  // enable texture coordinates
+        gluSphere(sphere, radius, 12, 12);
+        gluDeleteQuadric(sphere);
+    }
+    else {
+        int level = pickSphereLevel(obstacleLod, obstacleDrawX[index], obstacles.y[index], obstacles.z[index], radius);
+        glScalef(radius, radius, radius);
+        drawMesh(obstacleLod.mesh(level));
+        obstacleLod.countDrawn(level);
+    }
 
-    if (obstacleTexture) {
-        glBindTexture(GL_TEXTURE_2D, obstacleTexture);
-        glEnable(GL_TEXTURE_2D);
+    glPopMatrix();
+}
+// falls back to drawObstacle() per obstacle if the driver cannot instance
+void initObstacleInstancing() {
+    if (!useInstancing || legacyGeometry || !glext.hasInstancing) {
+        useInstancing = false;
+        return;
     }
 
-    // a temporary quadric for texture coordinates
-    GLUquadricObj* sphere = gluNewQuadric();
-    gluQuadricTexture(sphere, GL_TRUE);  // enable texture coordinates
-    gluSphere(sphere, obstacle.radius, 12, 12);
-    gluDeleteQuadric(sphere);
+    if (coreProfile) {
+        obstacleProgram = coreRenderer.buildProgram(OBSTACLE_CORE_VERTEX_SHADER, PHONG_FRAGMENT_SHADER);
+    }
+    else {
+        obstacleProgram = buildShaderProgram(OBSTACLE_VERTEX_SHADER, OBSTACLE_FRAGMENT_SHADER, {
+            { INSTANCE_POS_RADIUS_ATTRIB, "instancePosRadius" },
+            { INSTANCE_SPIN_ATTRIB, "instanceSpin" },
+        });
+    }
+    if (!obstacleProgram) {
+        useInstancing = false;
+        return;
+    }
+    obstacleUseTextureLocation = glext.getUniformLocation(obstacleProgram, "useTexture");
+    glext.genBuffers(1, &obstacleInstanceBuffer);
+    obstacleInstanceData.reserve(MAX_OBSTACLES * INSTANCE_FLOATS);
+    obstacleLevels.reserve(MAX_OBSTACLES);
+    obstacleLevelInstances.resize(obstacleLod.levels());
+}
+void drawObstaclesInstanced() {
+    if (obstacles.empty()) return;
+
+    // the instances go in grouped by lod level, one instanced draw per level.
+    // culled obstacles get level -1 and no instance. reserved for a full
+    // pool, so this never allocates
+    int levelCount = obstacleLod.levels();
+    std::vector<int>& levelInstances = obstacleLevelInstances;
+    levelInstances.assign(levelCount, 0);
+    obstacleLevels.clear();
+    for (int i = 0; i < obstacles.count; i++) {
+        if (!obstacleVisible[i]) {
+            obstacleLevels.push_back(-1);
+            continue;
+        }
+        obstacleLevels.push_back(pickSphereLevel(obstacleLod, obstacleDrawX[i], obstacles.y[i], obstacles.z[i], obstacles.radius[i]));
+        levelInstances[obstacleLevels.back()]++;
+    }
 
-    glPopMatrix();
+    obstacleInstanceData.clear();
+    float spin = lerp(prevGameTime, gameTime, renderAlpha) * 50.0f;
+    for (int level = 0; level < levelCount; level++) {
+        for (int i = 0; i < obstacles.count; i++) {
+            if (obstacleLevels[i] != level) continue;
+            obstacleInstanceData.push_back(obstacleDrawX[i]);
+            obstacleInstanceData.push_back(obstacles.y[i]);
+            obstacleInstanceData.push_back(obstacles.z[i]);
+            obstacleInstanceData.push_back(obstacles.radius[i]);
+            obstacleInstanceData.push_back(spin * obstacles.rotationSpeed[i]);
+        }
+    }
+
+    if (coreProfile) {
+        coreRenderer.setObject(viewMatrix, SCENE_MATERIAL, obstacleTexture);
+        coreRenderer.useProgram(obstacleProgram);
+    }
+    else {
+        if (obstacleTexture) {
+            glBindTexture(GL_TEXTURE_2D, obstacleTexture);
+        }
+        glext.useProgram(obstacleProgram);
+        glext.uniform1i(obstacleUseTextureLocation, obstacleTexture ? 1 : 0);
+    }
+
+    // orphan and refill the instance buffer every frame
+    glext.bindBuffer(GL_ARRAY_BUFFER, obstacleInstanceBuffer);
+    glext.bufferData(GL_ARRAY_BUFFER, obstacleInstanceData.size() * sizeof(float), obstacleInstanceData.data(), GL_STREAM_DRAW);
+
+    const GLsizei stride = INSTANCE_FLOATS * sizeof(float);
+    int firstInstance = 0;
+    for (int level = 0; level < levelCount; level++) {
+        if (levelInstances[level] == 0) continue;
+        const Mesh& sphere = obstacleLod.mesh(level);
+        // the instance attributes are left set up on the vertex array
+        if (coreProfile) coreRenderer.bindVertexArray(sphere.vao);
+        else bindMesh(sphere);
+
+        // the level's instances start firstInstance records into the buffer
+        const char* offset = reinterpret_cast<const char*>(static_cast<size_t>(firstInstance) * stride);
+        glext.bindBuffer(GL_ARRAY_BUFFER, obstacleInstanceBuffer);
+        glext.vertexAttribPointer(INSTANCE_POS_RADIUS_ATTRIB, 4, GL_FLOAT, GL_FALSE, stride, offset);
+        glext.vertexAttribPointer(INSTANCE_SPIN_ATTRIB, 1, GL_FLOAT, GL_FALSE, stride, offset + 4 * sizeof(float));
+        glext.enableVertexAttribArray(INSTANCE_POS_RADIUS_ATTRIB);
+        glext.enableVertexAttribArray(INSTANCE_SPIN_ATTRIB);
+        glext.vertexAttribDivisor(INSTANCE_POS_RADIUS_ATTRIB, 1);
+        glext.vertexAttribDivisor(INSTANCE_SPIN_ATTRIB, 1);
+
+        glext.drawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(sphere.indices.size()), GL_UNSIGNED_INT,
+            nullptr, levelInstances[level]);
+        obstacleLod.countDrawn(level, levelInstances[level]);
+        firstInstance += levelInstances[level];
+        if (coreProfile) continue;
+
+        glext.vertexAttribDivisor(INSTANCE_POS_RADIUS_ATTRIB, 0);
+        glext.vertexAttribDivisor(INSTANCE_SPIN_ATTRIB, 0);
+        glext.disableVertexAttribArray(INSTANCE_POS_RADIUS_ATTRIB);
+        glext.disableVertexAttribArray(INSTANCE_SPIN_ATTRIB);
+        unbindMesh(sphere);
+    }
+    if (coreProfile) {
+        glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+    glext.useProgram(0);
+}
+// the starfield has its own stream so it never shifts the spawner's sequence
+void initStars() {
+    starVertices.resize(starCount * STAR_FLOATS);
+    for (int i = 0; i < starCount; i++) {
+        float* star = &starVertices[i * STAR_FLOATS];
+        star[0] = starRandom.range(-50.0f, 50.0f);
+        star[1] = starRandom.range(-50.0f, 50.0f);
+        star[2] = starRandom.range(-50.0f, 50.0f);
+        star[3] = starRandom.uniform();
+    }
+
+    if (glext.hasBuffers) {
+        glext.genBuffers(1, &starBuffer);
+        glext.bindBuffer(GL_ARRAY_BUFFER, starBuffer);
+        glext.bufferData(GL_ARRAY_BUFFER, starVertices.size() * sizeof(float), starVertices.data(), GL_STATIC_DRAW);
+        glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if (starTwinkle && glext.hasShaders && !coreProfile) {
+        starProgram = buildShaderProgram(STAR_VERTEX_SHADER, STAR_FRAGMENT_SHADER, {
+            { STAR_PHASE_ATTRIB, "starPhase" },
+        });
+        starTimeLocation = starProgram ? glext.getUniformLocation(starProgram, "time") : -1;
+    }
 }
 void drawStars() {
+    if (starCount == 0) return;
+    PROFILE_SCOPE("drawStars");
+
+    if (coreProfile) {
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+        glPointSize(5.0f);
+        coreRenderer.setObject(viewMatrix, DEFAULT_MATERIAL, 0);
+        coreRenderer.useProgram(starProgram);
+        glext.uniform1f(starTimeLocation, seconds);
+        glext.uniform1i(starTwinkleLocation, starTwinkle ? 1 : 0);
+        coreRenderer.bindVertexArray(starVertexArray);
+        glDrawArrays(GL_POINTS, 0, starCount);
+        return;
+    }
+
     glPushMatrix();
     glDisable(GL_LIGHTING);
+    // plain colored points like the --core-profile ones, otherwise they
+    // sample whatever texture the last frame left bound
+    glDisable(GL_TEXTURE_2D);
 
     glEnable(GL_POINT_SMOOTH);
     glEnable(GL_BLEND);
 
-    const int numStars = 2000;
-
     // star size
     glPointSize(5.0f);
-    glBegin(GL_POINTS);
-    for (int i = 0; i < 500; i++) {
-        float x = -50.0f + static_cast<float>(rand() % 10000) / 100.0f;
-        float y = -50.0f + static_cast<float>(rand() % 10000) / 100.0f;
-        float z = -50.0f + static_cast<float>(rand() % 10000) / 100.0f;
 
+    const float* base = starVertices.data();
+    if (starBuffer) {
+        glext.bindBuffer(GL_ARRAY_BUFFER, starBuffer);
+        base = nullptr;
+    }
+    const GLsizei stride = STAR_FLOATS * sizeof(float);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, base);
+
+    if (starProgram) {
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+        glext.useProgram(starProgram);
+        glext.uniform1f(starTimeLocation, seconds);
+        glext.vertexAttribPointer(STAR_PHASE_ATTRIB, 1, GL_FLOAT, GL_FALSE, stride, base + 3);
+        glext.enableVertexAttribArray(STAR_PHASE_ATTRIB);
+    }
+    else {
         // blueish white?
         glColor3f(0.8f, 0.8f, 1.0f);
-        glVertex3f(x, y, z);
     }
-    glEnd();
+
+    glDrawArrays(GL_POINTS, 0, starCount);
+
+    if (starProgram) {
+        glext.disableVertexAttribArray(STAR_PHASE_ATTRIB);
+        glext.useProgram(0);
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    if (starBuffer) {
+        glext.bindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
     // reset rendering state
     glDisable(GL_BLEND);
     glDisable(GL_POINT_SMOOTH);
+    glEnable(GL_TEXTURE_2D);
     glEnable(GL_LIGHTING);
     glPopMatrix();
 }
 // -----------------------------------------
 void display() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    PROFILE_SCOPE("display");
+    benchFrameStart = std::chrono::steady_clock::now();
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    // swap in the textures the workers finished since the last frame
+    if (textureCache.loading() && textureCache.uploadFinished() > 0 && !textureCache.loading()) {
+        textureCache.printStats();
+    }
 
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    gluLookAt(
-        0.0f, cameraHeight, cameraDistance,  // position
-        0.0f, rocket.y, rocket.z - 2.0f,   // look at rocket
-        0.0f, 1.0f, 0.0f                   // up
-    );
+    float eye[3] = { 0.0f, cameraHeight, cameraDistance };
+    float center[3] = { 0.0f, lerp(rocket.prevY, rocket.y, renderAlpha), rocket.z - 2.0f }; // look at rocket
+    float up[3] = { 0.0f, 1.0f, 0.0f };
+    if (coreProfile) {
+        viewMatrix = lookAtMatrix(eye, center, up);
+        coreRenderer.beginFrame(perspectiveMatrix(FIELD_OF_VIEW, viewportAspect, Z_NEAR, Z_FAR), SCENE_LIGHT, SCENE_AMBIENT);
+    }
+    else {
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        gluLookAt(
+            eye[0], eye[1], eye[2],
+            center[0], center[1], center[2],
+            up[0], up[1], up[2]
+        );
+    }
+    viewFrustum = makeFrustum(eye, center, up, FIELD_OF_VIEW, viewportAspect, Z_NEAR, Z_FAR);
 
     drawStars();
 
@@ -491,11 +1568,46 @@ void display() {
 
     drawRocket();
 
-    for (auto& obstacle : obstacles) {
-        drawObstacle(obstacle);
+    {
+        PROFILE_SCOPE("drawObstacles");
+        int visible = cullObstacles();
+        if (useInstancing) {
+            drawObstaclesInstanced();
+        }
+        else {
+            // bound once for the field like the instanced path
+            if (obstacleTexture && visible > 0 && !coreProfile) {
+                glBindTexture(GL_TEXTURE_2D, obstacleTexture);
+            }
+            for (int i = 0; i < obstacles.count; i++) {
+                if (obstacleVisible[i]) drawObstacle(i);
+            }
+        }
     }
 
-    // display text
+    // the core profile has no raster position for bitmap text
+    if (!coreProfile) {
+        drawTextOverlay();
+    }
+
+    if (offscreen) return;
+
+    {
+        PROFILE_SCOPE("swapBuffers");
+        glutSwapBuffers();
+    }
+    reportFirstFrame();
+
+    framesThisSecond++;
+    updateRateCounters();
+
+    if (benchFrames > 0) {
+        recordBenchFrame();
+    }
+}
+
+// game over message and profiler overlay, in screen pixels
+void drawTextOverlay() {
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
     glLoadIdentity();
@@ -508,8 +1620,8 @@ void display() {
     glDisable(GL_LIGHTING);
     glDisable(GL_TEXTURE_2D);
 
-    // game over message 
-    if (gameOver) {
+    // game over message (bitmap fonts are glut, so not offscreen)
+    if (gameOver && !offscreen) {
         std::string gameOverText = "Game Over! Press 'R' to restart.";
         glColor3f(1.0f, 0.0f, 0.0f); // red
         glRasterPos2i(SCREEN_WIDTH / 2 - 120, SCREEN_HEIGHT / 2);
@@ -518,6 +1630,10 @@ void display() {
         }
     }
 
+    if (showProfiler && !offscreen) {
+        drawProfilerOverlay();
+    }
+
     glEnable(GL_LIGHTING);
     glEnable(GL_TEXTURE_2D);
 
@@ -525,11 +1641,175 @@ void display() {
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
     glMatrixMode(GL_MODELVIEW);
+}
+
+// top left, one line per scope, indented by nesting. the numbers are smoothed
+// over the last frames so they are readable
+void drawProfilerOverlay() {
+    PROFILE_SCOPE("drawProfilerOverlay");
+
+    auto drawLine = [](int line, const char* text) {
+        glRasterPos2i(10, SCREEN_HEIGHT - 20 - line * 14);
+        for (const char* c = text; *c; c++) {
+            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+        }
+    };
+
+    char text[128];
+    glColor3f(1.0f, 1.0f, 0.3f); // yellow
+    snprintf(text, sizeof(text), "frame  %.2f ms", profiler.frameMs());
+    drawLine(0, text);
+
+    int line = 1;
+    for (const auto& stat : profiler.frameStats()) {
+        snprintf(text, sizeof(text), "%*s%s  %.3f ms  x%d", stat.depth * 4, "", stat.name, stat.averageMs, stat.calls);
+        drawLine(line++, text);
+    }
+}
+
+// wait for the frame to really finish so software rasterizers are measured too
+void recordBenchFrame() {
+    glFinish();
+    auto end = std::chrono::steady_clock::now();
+    benchFrameTimes.push_back(std::chrono::duration<double, std::milli>(end - benchFrameStart).count());
+
+    if (static_cast<int>(benchFrameTimes.size()) < benchFrames) return;
+
+    printRenderSettings();
+    printFrameTimeSummary(benchFrameTimes);
+    printFrameTimeHistogram(benchFrameTimes);
+    printLodStats(static_cast<int>(benchFrameTimes.size()));
+    exit(0);
+}
+
+void printRenderSettings() {
+    std::cout << "renderer:    " << glGetString(GL_RENDERER) << "\n";
+    std::cout << "pipeline:    " << (coreProfile ? "gl 3.3 core, per pixel phong" : "fixed function") << "\n";
+    std::cout << "geometry:    " << (legacyGeometry ? "glu quadrics" : "cached meshes") << "\n";
+    std::cout << "obstacles:   " << (useInstancing ? "instanced" : "per object") << "\n";
+    std::cout << "sphere lod:  " << (legacyGeometry ? "off (glu quadrics)" : obstacleLod.enabled ? "on" : "off") << "\n";
+    std::cout << "culling:     " << (frustumCulling ? "on" : "off") << " (" << frustumCullName() << ")\n";
+    std::cout << "mip filter:  " << (textureCache.sampling.mipmaps ? mipFilterName(textureCache.sampling.mipFilter) : "off")
+        << ", anisotropy " << textureCache.sampling.anisotropy << " (max " << maxTextureAnisotropy() << ")\n";
+    std::cout << "compressed:  " << (glext.hasS3TC ? "bc1/bc3 " : "") << (glext.hasETC2 ? "etc2" : "")
+        << (glext.hasS3TC || glext.hasETC2 ? "" : "none") << (textureCache.sampling.compressed ? "" : " (off)") << "\n";
+    std::cout << std::flush;
+}
+
+// renders the game into an egl pbuffer, one tick per frame, and times every
+// frame from the start of display() until the gpu (or llvmpipe) is done
+bool runOffscreen(int frames) {
+#ifdef OFFSCREEN
+    if (!createOffscreenContext(SCREEN_WIDTH, SCREEN_HEIGHT, coreProfile)) return false;
+    offscreen = true;
+    glProcSource = eglProcAddress;
+    startTime = std::chrono::steady_clock::now();
+
+    if (!init()) return false;
+    reshape(SCREEN_WIDTH, SCREEN_HEIGHT);
+    printRenderSettings();
+
+    std::vector<double> frameTimes;
+    for (int frame = 0; frame < frames; frame++) {
+        tickSimulation();
+        renderAlpha = 1.0f;
+
+        auto start = std::chrono::steady_clock::now();
+        display();
+        glFinish();
+        auto end = std::chrono::steady_clock::now();
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        printf("frame %d: %.3f ms\n", frame, frameTimes.back());
+        reportFirstFrame();
+
+        // decoding is done before the timed frames so they all see the same
+        // work: the uploads, in one go or streamed (--stream-textures)
+        textureCache.waitForDecoding();
+
+        if (dumpFramesPrefix) {
+            char filename[512];
+            snprintf(filename, sizeof(filename), "%s%04d.ppm", dumpFramesPrefix, frame);
+            writeFramePPM(filename, SCREEN_WIDTH, SCREEN_HEIGHT);
+        }
+    }
+    printFrameTimeSummary(frameTimes);
+    printFrameTimeHistogram(frameTimes);
+    printLodStats(frames);
+    return true;
+#else
+    (void)frames;
+    std::cout << "--offscreen needs a build with -DOFFSCREEN (and -lEGL)" << std::endl;
+    return false;
+#endif
+}
+
+// sphere triangles per frame, drawn against what full detail would have cost,
+// and how many obstacles the frustum kept
+void printLodStats(int frames) {
+    if (frames <= 0) return;
+    printf("culling:     %.1f obstacles/frame drawn, %.1f culled\n",
+        static_cast<double>(obstaclesDrawn) / frames, static_cast<double>(obstaclesCulled) / frames);
+    if (coreProfile) {
+        printf("core:        %lld object blocks/frame\n", coreRenderer.objects / frames);
+    }
+    if (legacyGeometry) return;
+    printf("earth:       %lld triangles/frame (%lld at full detail)\n",
+        earthLod.trianglesDrawn / frames, earthLod.trianglesFull / frames);
+    printf("obstacles:   %lld triangles/frame (%lld at full detail)\n",
+        obstacleLod.trianglesDrawn / frames, obstacleLod.trianglesFull / frames);
+}
+
+// interpolated obstacle positions for this frame and which of them can be on
+// screen, against the frustum set up in display(). returns how many can
+int cullObstacles() {
+    for (int i = 0; i < obstacles.count; i++) {
+        obstacleDrawX[i] = lerp(obstacles.prevX[i], obstacles.x[i], renderAlpha);
+    }
+    int visible = obstacles.count;
+    if (frustumCulling)
+        visible = cullSpheres(viewFrustum, obstacleDrawX, obstacles.y, obstacles.z, obstacles.radius, obstacles.count, obstacleVisible);
+    else
+        memset(obstacleVisible, 1, obstacles.count);
+    obstaclesDrawn += visible;
+    obstaclesCulled += obstacles.count - visible;
+    return visible;
+}
+
+// picks a lod level for a sphere from its distance to the camera in display()
+int pickSphereLevel(const SphereLod& lod, float x, float y, float z, float radius) {
+    float dx = x, dy = y - cameraHeight, dz = z - cameraDistance;
+    float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+    return lod.pick(projectedRadius(radius, distance, FIELD_OF_VIEW, viewportHeight));
+}
+
+// launch to the first finished frame, compare with and without --sync-textures
+void reportFirstFrame() {
+    if (firstFrameShown) return;
+    firstFrameShown = true;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launchTime).count();
+    printf("first frame: %.1f ms after launch (%s textures)\n", ms, syncTextures ? "sync" : "async");
+}
+
+float lerp(float from, float to, float alpha) {
+    return from + (to - from) * alpha;
+}
 
-    glutSwapBuffers();
+// remember where everything was so display() can blend between two ticks
+void savePreviousState() {
+    rocket.prevX = rocket.x;
+    rocket.prevY = rocket.y;
+    memcpy(obstacles.prevX, obstacles.x, obstacles.count * sizeof(float));
+    memcpy(obstacles.prevY, obstacles.y, obstacles.count * sizeof(float));
+    prevGameTime = gameTime;
+    prevEarthRotationAngle = earthRotationAngle;
 }
 
-void timer(int value) {
+// one fixed simulation step, no gl calls in here so it can run headless
+void tickSimulation() {
+    PROFILE_SCOPE("tickSimulation");
+    savePreviousState();
+    simTick++;
+
     // update earth rotation, even if game is over (looks nicer)
     earthRotationAngle += earthRotationSpeed;
     if (earthRotationAngle > 360.0f) {
@@ -537,16 +1817,215 @@ void timer(int value) {
     }
 
     updateGame();
+}
+
+// runs the game logic as fast as the cpu allows, no window and no gl context
+// the game restarts by itself on game over so long runs keep doing work
+void runHeadless(long long ticks) {
+    resetGame();
+
+    long long gameOvers = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < ticks; i++) {
+        tickSimulation();
+        if (gameOver) {
+            // restarts like the 'r' key, so --record stores it and the
+            // recording replays
+            gameOvers++;
+            gameInput(INPUT_KEY, 'r');
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "ticks:       " << ticks << "\n";
+    std::cout << "seconds:     " << seconds << "\n";
+    std::cout << "ticks/sec:   " << (seconds > 0.0 ? ticks / seconds : 0.0) << "\n";
+    std::cout << "game overs:  " << gameOvers << "\n";
+    std::cout << "obstacles:   " << obstacles.size() << "/" << MAX_OBSTACLES
+        << " (peak " << obstacles.peak << ")\n";
+    std::cout << "spawned:     " << obstacles.spawned << "\n";
+    std::cout << "recycled:    " << obstacles.recycled << "\n";
+    std::cout << "dropped:     " << obstacles.dropped << "\n";
+}
+
+void writeTrace() {
+    if (profiler.writeChromeTrace(traceFilename)) {
+        std::cout << "trace: " << profiler.traceEventCount() << " events written to " << traceFilename << std::endl;
+    }
+    else {
+        std::cout << "Failed to write trace: " << traceFilename << std::endl;
+    }
+}
+
+// the collision loop before it went soa: sqrt per obstacle
+int sweepSpheresSqrt(const float* x, const float* y, const float* z, const float* radius,
+    int count, float px, float py, float pz, float pr) {
+    for (int i = 0; i < count; i++) {
+        float dx = px - x[i];
+        float dy = py - y[i];
+        float dz = pz - z[i];
+        if (sqrtf(dx * dx + dy * dy + dz * dz) < pr + radius[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// times a full miss query (the worst case, nothing exits early). the field
+// gets wider as it grows so the density around the rocket stays like in game,
+// which is what keeps the grid query flat while brute force grows with it
+void runCollisionBenchmark() {
+    const int sizes[] = { 10000, 100000, 1000000 };
+    const long long testsPerRun = 200000000; // brute force obstacle tests per variant and size
+    const float density = 4.0f;              // obstacles per unit of field width
+
+    std::cout << "simd: " << collisionSweepName() << "\n";
+    std::cout << "obstacles   sqrt us/query   squared us/query   simd us/query   grid us/query   grid build ns/obs   candidates/query   pairs ns/obs   touching pairs\n";
+
+    Pcg32 benchRandom(1234, STREAM_BENCH);
+    for (int count : sizes) {
+        float width = count / density;
+        std::vector<float> x(count), y(count), z(count), radius(count);
+        for (int i = 0; i < count; i++) {
+            x[i] = benchRandom.range(-width / 2, width / 2);
+            y[i] = 0.5f + static_cast<float>(benchRandom.below(40)) / 10.0f;
+            z[i] = 0.0f;
+            radius[i] = 0.3f + static_cast<float>(benchRandom.below(20)) / 500.0f;
+        }
+        // probe just above the field so every candidate is tested and missed
+        const float pr = 0.2f, py = 4.4f + 0.34f + pr + 0.01f, pz = 0.0f;
+        const float maxRadius = 0.34f;
+
+        int repeats = static_cast<int>(testsPerRun / count);
+        volatile int sink = 0;
+        double results[4];
+        for (int variant = 0; variant < 3; variant++) {
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; r++) {
+                float px = x[r % count];
+                if (variant == 0)
+                    sink = sink + sweepSpheresSqrt(x.data(), y.data(), z.data(), radius.data(), count, px, py, pz, pr);
+                else if (variant == 1)
+                    sink = sink + sweepSpheresScalar(x.data(), y.data(), z.data(), radius.data(), 0, count, px, py, pz, pr);
+                else
+                    sink = sink + sweepSpheres(x.data(), y.data(), z.data(), radius.data(), count, px, py, pz, pr);
+            }
+            auto end = std::chrono::steady_clock::now();
+            results[variant] = std::chrono::duration<double, std::micro>(end - start).count() / repeats;
+        }
+
+        SpatialGrid2D grid;
+        grid.init(-width / 2, GRID_MIN_Y, width / 2, GRID_MAX_Y, GRID_CELL_SIZE, count);
+        auto buildStart = std::chrono::steady_clock::now();
+        grid.clear();
+        for (int i = 0; i < count; i++) {
+            grid.insert(i, x[i], y[i]);
+        }
+        auto buildEnd = std::chrono::steady_clock::now();
+        double buildNs = std::chrono::duration<double, std::nano>(buildEnd - buildStart).count() / count;
+
+        const int queries = 1000000;
+        int visited = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int q = 0; q < queries; q++) {
+            float px = x[q % count];
+            sink = sink + grid.query(px, py, pr + maxRadius, [&](int i) {
+                visited++;
+                float dx = px - x[i];
+                float dy = py - y[i];
+                float dz = pz - z[i];
+                float reach = pr + radius[i];
+                return dx * dx + dy * dy + dz * dz < reach * reach;
+            });
+        }
+        auto end = std::chrono::steady_clock::now();
+        results[3] = std::chrono::duration<double, std::micro>(end - start).count() / queries;
+
+        // every obstacle against its neighbours through the same grid
+        long long pairs = 0;
+        auto pairsStart = std::chrono::steady_clock::now();
+        forEachOverlappingPair(grid, x.data(), y.data(), z.data(), radius.data(), count, maxRadius, [&](int, int) { pairs++; });
+        auto pairsEnd = std::chrono::steady_clock::now();
+        double pairsNs = std::chrono::duration<double, std::nano>(pairsEnd - pairsStart).count() / count;
+
+        printf("%9d   %13.3f   %16.3f   %13.3f   %13.3f   %17.2f   %16.1f   %12.2f   %14lld\n",
+            count, results[0], results[1], results[2], results[3], buildNs, static_cast<double>(visited) / queries, pairsNs, pairs);
+
+        // the smallest field is cheap enough to count the pairs brute force too
+        if (count == sizes[0]) {
+            long long brutePairs = 0;
+            for (int a = 0; a < count; a++) {
+                for (int b = a + 1; b < count; b++) {
+                    float dx = x[a] - x[b];
+                    float dy = y[a] - y[b];
+                    float dz = z[a] - z[b];
+                    float reach = radius[a] + radius[b];
+                    if (dx * dx + dy * dy + dz * dz < reach * reach) brutePairs++;
+                }
+            }
+            if (brutePairs != pairs) {
+                std::cout << "touching pairs differ: grid " << pairs << ", brute force " << brutePairs << "\n";
+            }
+        }
+    }
+}
+
+// fixed timestep accumulator: the simulation always advances in SIM_DT steps
+// and the renderer draws as often as it can, blending between the last two ticks
+void idle() {
+    // a profiler frame runs from one idle call to the next: ticks, then drawing
+    profiler.endFrame();
+    profiler.beginFrame();
+
+    auto now = std::chrono::steady_clock::now();
+    double frameTime = std::chrono::duration<double>(now - lastFrameTime).count();
+    lastFrameTime = now;
+
+    if (frameTime > MAX_FRAME_TIME) {
+        frameTime = MAX_FRAME_TIME;
+    }
+    simAccumulator += frameTime;
+
+    // benchmarks do exactly one tick per frame so every run draws the same scenes
+    if (benchFrames > 0) {
+        simAccumulator = SIM_DT;
+    }
+
+    while (simAccumulator >= SIM_DT) {
+        tickSimulation();
+        simAccumulator -= SIM_DT;
+        simTicksThisSecond++;
+    }
+    renderAlpha = static_cast<float>(simAccumulator / SIM_DT);
 
     glutPostRedisplay();
-    glutTimerFunc(16, timer, 0);  // ~60 FPS
+}
+
+// show sim and render rates separately in the title bar
+void updateRateCounters() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - rateWindowStart).count();
+    if (elapsed < 1.0) return;
+
+    char title[160];
+    snprintf(title, sizeof(title), "Rocket Game | sim %.1f Hz | render %.1f Hz | obstacles %d/%d",
+        simTicksThisSecond / elapsed, framesThisSecond / elapsed, obstacles.size(), MAX_OBSTACLES);
+    glutSetWindowTitle(title);
+
+    simTicksThisSecond = 0;
+    framesThisSecond = 0;
+    rateWindowStart = now;
 }
 void reshape(int width, int height) {
     glViewport(0, 0, width, height);
+    viewportHeight = height;
+    viewportAspect = (float)width / (float)height;
+    if (coreProfile) return; // display() builds the projection
 
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(45.0f, (float)width / (float)height, 0.1f, 100.0f);
+    gluPerspective(FIELD_OF_VIEW, (float)width / (float)height, Z_NEAR, Z_FAR);
 
     glMatrixMode(GL_MODELVIEW);
 }
\ No newline at end of file
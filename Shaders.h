@@ -0,0 +1,71 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include "GLExtensions.h"
+
+// small glsl helpers, everything returns 0 on failure so callers can fall
+// back to the fixed function path
+
+struct AttribBinding {
+    GLuint index;
+    const char* name;
+};
+
+inline GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glext.createShader(type);
+    glext.shaderSource(shader, 1, &source, nullptr);
+    glext.compileShader(shader);
+
+    GLint ok = 0;
+    glext.getShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        GLint length = 0;
+        glext.getShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::string log(length > 0 ? length : 1, '\0');
+        glext.getShaderInfoLog(shader, static_cast<GLsizei>(log.size()), nullptr, &log[0]);
+        std::cout << "Failed to compile shader: " << log << std::endl;
+        glext.deleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// attribute locations have to be bound before linking
+inline GLuint buildShaderProgram(const char* vertexSource, const char* fragmentSource,
+    const std::vector<AttribBinding>& attribs = {}) {
+    if (!glext.hasShaders) return 0;
+
+    GLuint vertex = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vertex || !fragment) {
+        if (vertex) glext.deleteShader(vertex);
+        if (fragment) glext.deleteShader(fragment);
+        return 0;
+    }
+
+    GLuint program = glext.createProgram();
+    glext.attachShader(program, vertex);
+    glext.attachShader(program, fragment);
+    for (const auto& attrib : attribs) {
+        glext.bindAttribLocation(program, attrib.index, attrib.name);
+    }
+    glext.linkProgram(program);
+
+    // the program keeps them alive
+    glext.deleteShader(vertex);
+    glext.deleteShader(fragment);
+
+    GLint ok = 0;
+    glext.getProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        GLint length = 0;
+        glext.getProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::string log(length > 0 ? length : 1, '\0');
+        glext.getProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, &log[0]);
+        std::cout << "Failed to link shader program: " << log << std::endl;
+        glext.deleteProgram(program);
+        return 0;
+    }
+    return program;
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+// uniform grid over a rectangle of the x/y plane, used as a collision broad
+// phase. every cell is a singly linked list of object indices, so inserting
+// is O(1) and clearing only touches the cell heads. things outside the
+// rectangle are clamped into the border cells, so nothing is ever lost
+class SpatialGrid2D {
+public:
+    // allocates, call once up front
+    void init(float minX, float minY, float maxX, float maxY, float cellSize, int capacity) {
+        this->minX = minX;
+        this->minY = minY;
+        this->cellSize = cellSize;
+        columns = std::max(1, static_cast<int>((maxX - minX) / cellSize + 0.999f));
+        rows = std::max(1, static_cast<int>((maxY - minY) / cellSize + 0.999f));
+        head.assign(columns * rows, -1);
+        next.assign(capacity, -1);
+    }
+
+    void clear() {
+        std::fill(head.begin(), head.end(), -1);
+    }
+
+    void insert(int index, float x, float y) {
+        int cell = cellRow(y) * columns + cellColumn(x);
+        next[index] = head[cell];
+        head[cell] = index;
+    }
+
+    // calls visit(index) for everything in the cells touching the square of
+    // half size reach around (x, y). visit returns true to stop early, and
+    // query then returns true as well
+    template <typename Visit>
+    bool query(float x, float y, float reach, Visit visit) const {
+        int column0 = cellColumn(x - reach), column1 = cellColumn(x + reach);
+        int row0 = cellRow(y - reach), row1 = cellRow(y + reach);
+        for (int row = row0; row <= row1; row++) {
+            for (int column = column0; column <= column1; column++) {
+                for (int i = head[row * columns + column]; i >= 0; i = next[i]) {
+                    if (visit(i)) return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    int cellCount() const { return columns * rows; }
+
+private:
+    int cellColumn(float x) const {
+        int column = static_cast<int>((x - minX) / cellSize);
+        return std::min(std::max(column, 0), columns - 1);
+    }
+
+    int cellRow(float y) const {
+        int row = static_cast<int>((y - minY) / cellSize);
+        return std::min(std::max(row, 0), rows - 1);
+    }
+
+    float minX = 0.0f, minY = 0.0f, cellSize = 1.0f;
+    int columns = 1, rows = 1;
+    std::vector<int> head; // first index in each cell, -1 when empty
+    std::vector<int> next; // next index in the same cell
+};
+
+// uniform grid over a box, for 3d broad phases with every item moving every
+// step. build() counting sorts all items by cell, so a cell's items sit next
+// to each other in one array and the whole thing is rebuilt in two passes.
+// once built it is read only, so any number of threads can query it.
+// items outside the box are clamped into the border cells
+class SpatialGrid3D {
+public:
+    // cellSize should be at least the largest item diameter, then every
+    // overlapping pair is in the same or neighbouring cells
+    void init(float minX, float minY, float minZ, float maxX, float maxY, float maxZ, float cellSize) {
+        boundsMin[0] = minX; boundsMin[1] = minY; boundsMin[2] = minZ;
+        float extent[3] = { maxX - minX, maxY - minY, maxZ - minZ };
+        this->cellSize = cellSize;
+        for (int axis = 0; axis < 3; axis++) {
+            cells[axis] = std::max(1, static_cast<int>(extent[axis] / cellSize + 0.999f));
+        }
+        cellStart.assign(cellCount() + 1, 0);
+    }
+
+    void build(const float* x, const float* y, const float* z, int count) {
+        itemCell.resize(count);
+        items.resize(count);
+        std::fill(cellStart.begin(), cellStart.end(), 0);
+        for (int i = 0; i < count; i++) {
+            itemCell[i] = cellOf(x[i], y[i], z[i]);
+            cellStart[itemCell[i] + 1]++;
+        }
+        for (int cell = 0; cell < cellCount(); cell++) {
+            cellStart[cell + 1] += cellStart[cell];
+        }
+        // cellStart[cell] moves along as the cell fills, then is shifted back
+        for (int i = 0; i < count; i++) {
+            items[cellStart[itemCell[i]]++] = i;
+        }
+        for (int cell = cellCount(); cell > 0; cell--) {
+            cellStart[cell] = cellStart[cell - 1];
+        }
+        cellStart[0] = 0;
+    }
+
+    // calls visit(a, b) once for every pair of items sharing a cell or in
+    // neighbouring cells, for the cells in [firstCell, endCell). each cell
+    // pairs up with itself and the 13 neighbours ahead of it, so splitting
+    // the cells into ranges never visits a pair twice
+    template <typename Visit>
+    void forEachPair(int firstCell, int endCell, Visit visit) const {
+        static const int ahead[13][3] = {
+            { 1, 0, 0 },
+            { -1, 1, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+            { -1, -1, 1 }, { 0, -1, 1 }, { 1, -1, 1 },
+            { -1, 0, 1 }, { 0, 0, 1 }, { 1, 0, 1 },
+            { -1, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 },
+        };
+        for (int cell = firstCell; cell < endCell; cell++) {
+            int begin = cellStart[cell], end = cellStart[cell + 1];
+            if (begin == end) continue;
+            int cx = cell % cells[0], cy = (cell / cells[0]) % cells[1], cz = cell / (cells[0] * cells[1]);
+
+            for (int a = begin; a < end; a++) {
+                for (int b = a + 1; b < end; b++) visit(items[a], items[b]);
+            }
+            for (const auto& offset : ahead) {
+                int nx = cx + offset[0], ny = cy + offset[1], nz = cz + offset[2];
+                if (nx < 0 || ny < 0 || nx >= cells[0] || ny >= cells[1] || nz >= cells[2]) continue;
+                int neighbour = (nz * cells[1] + ny) * cells[0] + nx;
+                int neighbourBegin = cellStart[neighbour], neighbourEnd = cellStart[neighbour + 1];
+                for (int a = begin; a < end; a++) {
+                    for (int b = neighbourBegin; b < neighbourEnd; b++) visit(items[a], items[b]);
+                }
+            }
+        }
+    }
+
+    int cellCount() const { return cells[0] * cells[1] * cells[2]; }
+
+private:
+    int cellCoordinate(float value, int axis) const {
+        int cell = static_cast<int>((value - boundsMin[axis]) / cellSize);
+        return std::min(std::max(cell, 0), cells[axis] - 1);
+    }
+
+    int cellOf(float x, float y, float z) const {
+        return (cellCoordinate(z, 2) * cells[1] + cellCoordinate(y, 1)) * cells[0] + cellCoordinate(x, 0);
+    }
+
+    float boundsMin[3] = { 0, 0, 0 };
+    float cellSize = 1.0f;
+    int cells[3] = { 1, 1, 1 };
+    std::vector<int> cellStart; // items of cell c are items[cellStart[c] .. cellStart[c + 1])
+    std::vector<int> items;     // item indices sorted by cell
+    std::vector<int> itemCell;
+};
@@ -0,0 +1,597 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include "BlockCompression.h"
+#include "GLExtensions.h"
+#include "KtxFile.h"
+#include "MipChain.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+
+// one loader for every demo. textures are deduped by path, and the decoded
+// rgba mip chain of every image is kept next to it in <image>.texcache so
+// later launches map that file instead of decoding the jpeg again. the cache
+// remembers the size and modification time of its source and is rebuilt when
+// either changes. every mip filter has its own cache file.
+// block compressed <image>.<format>.ktx files from TextureCompressor win over
+// both when the driver supports their format (see loadGLExtensions())
+// loadAsync() hands the decoding to worker threads and shows a placeholder
+// until uploadFinished() puts the real image into the same texture name,
+// all at once or, with streaming on, a few tiles per frame (TextureStreamer.h)
+
+// read only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) { *this = std::move(other); }
+
+    MappedFile& operator=(MappedFile&& other) {
+        if (this != &other) {
+            close();
+            data = other.data;
+            size = other.size;
+#ifdef _WIN32
+            mapping = other.mapping;
+            other.mapping = nullptr;
+#endif
+            other.data = nullptr;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    ~MappedFile() { close(); }
+
+    bool open(const char* filename) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) return false;
+        data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data) {
+            CloseHandle(mapping);
+            mapping = nullptr;
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int file = ::open(filename, O_RDONLY);
+        if (file < 0) return false;
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size == 0) {
+            ::close(file);
+            return false;
+        }
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (mapped == MAP_FAILED) return false;
+        data = static_cast<const unsigned char*>(mapped);
+        size = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void close() {
+        if (!data) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        munmap(const_cast<unsigned char*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+private:
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// a decoded image and its mip chain, either owned or mapped from the cache
+struct TextureData {
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+    const unsigned char* pixels = nullptr; // rgba8, every level, see MipChain.h
+    double mipBuildMs = 0.0;               // 0 when it came from the cache
+
+    // block compressed instead: levels point into the mapped ktx file
+    BlockFormat compressedFormat = BLOCK_BC1;
+    std::vector<KtxLevel> compressedLevels;
+    std::vector<unsigned char> owned;
+    MappedFile mapped;
+};
+
+// the cache file is this header followed by the mip chain
+struct TextureCacheHeader {
+    char magic[4];       // "TXC1"
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    uint32_t filter;     // MipFilter the levels were built with
+};
+
+const uint32_t TEXTURE_CACHE_VERSION = 2;
+
+inline std::string textureCachePath(const char* filename, MipFilter filter) {
+    return std::string(filename) + "." + mipFilterName(filter) + ".texcache";
+}
+
+inline bool sourceFileInfo(const char* filename, uint64_t& size, int64_t& time) {
+    struct stat info;
+    if (stat(filename, &info) != 0) return false;
+    size = static_cast<uint64_t>(info.st_size);
+    time = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+// maps <filename>.texcache if it is still up to date with filename
+inline bool readTextureCache(const char* filename, MipFilter filter, TextureData& texture) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!sourceFileInfo(filename, sourceSize, sourceTime)) return false;
+
+    MappedFile file;
+    if (!file.open(textureCachePath(filename, filter).c_str())) return false;
+    if (file.size < sizeof(TextureCacheHeader)) return false;
+
+    TextureCacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, "TXC1", 4) != 0 || header.version != TEXTURE_CACHE_VERSION) return false;
+    if (header.sourceSize != sourceSize || header.sourceTime != sourceTime) return false;
+    if (header.filter != static_cast<uint32_t>(filter)) return false;
+    if (header.width == 0 || header.height == 0) return false;
+    if (static_cast<int>(header.levels) != mipLevelCount(header.width, header.height)) return false;
+    if (file.size != sizeof(header) + mipChainSize(header.width, header.height)) return false;
+
+    texture.width = header.width;
+    texture.height = header.height;
+    texture.levels = header.levels;
+    texture.mipBuildMs = 0.0;
+    texture.owned.clear();
+    texture.mapped = std::move(file);
+    texture.pixels = texture.mapped.data + sizeof(header);
+    return true;
+}
+
+inline bool writeTextureCache(const char* filename, MipFilter filter, const TextureData& texture) {
+    TextureCacheHeader header = {};
+    memcpy(header.magic, "TXC1", 4);
+    header.version = TEXTURE_CACHE_VERSION;
+    if (!sourceFileInfo(filename, header.sourceSize, header.sourceTime)) return false;
+    header.width = texture.width;
+    header.height = texture.height;
+    header.levels = texture.levels;
+    header.filter = filter;
+
+    // written to a temporary name first so a crash never leaves half a cache
+    std::string path = textureCachePath(filename, filter);
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) return false;
+    size_t size = mipChainSize(texture.width, texture.height);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(texture.pixels, 1, size, file) == size;
+    written = fclose(file) == 0 && written;
+    remove(path.c_str());
+    if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline std::string compressedTexturePath(const char* filename, BlockFormat format) {
+    return std::string(filename) + "." + blockFormatName(format) + ".ktx";
+}
+
+// maps <filename>.<format>.ktx for the first format that has a usable file.
+// files older than their image are stale and skipped
+inline bool readCompressedTexture(const char* filename, const std::vector<BlockFormat>& formats, TextureData& texture) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!sourceFileInfo(filename, sourceSize, sourceTime)) return false;
+
+    for (BlockFormat format : formats) {
+        std::string path = compressedTexturePath(filename, format);
+        uint64_t size;
+        int64_t time;
+        if (!sourceFileInfo(path.c_str(), size, time)) continue;
+        if (time < sourceTime) {
+            printf("Ignoring %s, it is older than %s\n", path.c_str(), filename);
+            continue;
+        }
+
+        MappedFile file;
+        KtxHeader header;
+        std::vector<KtxLevel> levels;
+        if (!file.open(path.c_str()) || !parseKtx(file.data, file.size, header, levels)) continue;
+        if (header.glInternalFormat != blockFormatGLEnum(format)) continue;
+
+        // only whole chains, with every level the size its format says
+        int width = header.pixelWidth, height = header.pixelHeight;
+        bool complete = static_cast<int>(levels.size()) == mipLevelCount(width, height);
+        for (size_t level = 0; complete && level < levels.size(); level++) {
+            complete = levels[level].size == compressedLevelSize(format, mipWidth(width, level), mipHeight(height, level));
+        }
+        if (!complete) continue;
+
+        texture.width = width;
+        texture.height = height;
+        texture.levels = static_cast<int>(levels.size());
+        texture.mipBuildMs = 0.0;
+        texture.owned.clear();
+        texture.mapped = std::move(file);
+        texture.pixels = texture.mapped.data;
+        texture.compressedFormat = format;
+        texture.compressedLevels = levels;
+        return true;
+    }
+    return false;
+}
+
+inline bool readWholeFile(const char* filename, std::vector<unsigned char>& bytes) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    bytes.resize(size > 0 ? size : 0);
+    bool read = size > 0 && fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    fclose(file);
+    return read;
+}
+
+// decodes the image with stb_image and builds its mip chain. the file is
+// read up front and decoded from memory, so this is safe on any thread
+inline bool decodeTexture(const char* filename, MipFilter filter, TextureData& texture) {
+    std::vector<unsigned char> encoded;
+    if (!readWholeFile(filename, encoded)) return false;
+
+    int width, height, channels;
+    unsigned char* image = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()),
+        &width, &height, &channels, STBI_rgb_alpha);
+    if (!image) return false;
+
+    texture.width = width;
+    texture.height = height;
+    texture.levels = mipLevelCount(width, height);
+    texture.owned.resize(mipChainSize(width, height));
+    memcpy(texture.owned.data(), image, static_cast<size_t>(width) * height * 4);
+    stbi_image_free(image);
+
+    auto start = std::chrono::steady_clock::now();
+    buildMipChain(texture.owned.data(), width, height, filter);
+    texture.mipBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    texture.pixels = texture.owned.data();
+    return true;
+}
+
+// how textures are sampled, set on the cache before loading
+struct TextureSampling {
+    bool mipmaps = true;                   // false = level 0 only and plain GL_LINEAR, like before the mip chains
+    MipFilter mipFilter = MIP_FILTER_BOX;  // ktx files keep whatever filter they were made with
+    bool compressed = true;                // use TextureCompressor's ktx files when the gpu can
+    float anisotropy = 1.0f;               // 1 = off, clamped to what the driver allows
+};
+
+// 1 when GL_EXT_texture_filter_anisotropic is missing
+inline float maxTextureAnisotropy() {
+    if (!hasGLExtension("GL_EXT_texture_filter_anisotropic") && !hasGLExtension("GL_ARB_texture_filter_anisotropic")) {
+        return 1.0f;
+    }
+    GLfloat maximum = 1.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maximum);
+    return maximum;
+}
+
+// repeating, and with mipmaps trilinear (and anisotropic when asked for)
+// filtered. applies to the bound texture
+inline void setTextureSampling(int levels, bool mipmaps, float anisotropy) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    if (anisotropy > 1.0f) {
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+    }
+}
+
+// uploads the texture, every level when mipmaps are on
+inline void uploadTexture(GLuint textureID, const TextureData& texture, bool mipmaps = true, float anisotropy = 1.0f) {
+    int levels = mipmaps ? texture.levels : 1;
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    setTextureSampling(levels, mipmaps, anisotropy);
+
+    if (!texture.compressedLevels.empty()) {
+        for (int level = 0; level < levels; level++) {
+            const KtxLevel& data = texture.compressedLevels[level];
+            glext.compressedTexImage2D(GL_TEXTURE_2D, level, blockFormatGLEnum(texture.compressedFormat),
+                mipWidth(texture.width, level), mipHeight(texture.height, level), 0,
+                static_cast<GLsizei>(data.size), texture.pixels + data.offset);
+        }
+        return;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int level = 0; level < levels; level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, mipWidth(texture.width, level), mipHeight(texture.height, level), 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels + mipLevelOffset(texture.width, texture.height, level));
+    }
+}
+
+// 1x1 mid grey shown while the real image is still decoding
+inline void uploadPlaceholderTexture(GLuint textureID) {
+    TextureData placeholder;
+    placeholder.width = placeholder.height = placeholder.levels = 1;
+    placeholder.owned = { 128, 128, 128, 255 };
+    placeholder.pixels = placeholder.owned.data();
+    uploadTexture(textureID, placeholder);
+}
+
+class TextureCache {
+public:
+    TextureSampling sampling;
+
+    // loadAsync() textures go up in tiles, at most this much per frame
+    bool streaming = false;
+    size_t streamBudgetBytes = 1024 * 1024;
+
+    // texture name for the image, 0 if it cannot be loaded. loading the same
+    // path twice returns the same texture
+    GLuint load(const char* filename) {
+        auto found = textures.find(filename);
+        if (found != textures.end()) {
+            sharedCount++;
+            return found->second;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        chooseCompressedFormats();
+        TextureData texture;
+        if (!readOrDecode(filename, sampling.mipFilter, compressedFormats, texture)) {
+            printf("Failed to load texture: %s\n", filename);
+            textures[filename] = 0;
+            return 0;
+        }
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        upload(textureID, texture);
+        textures[filename] = textureID;
+        loadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return textureID;
+    }
+
+    // same as load() but returns right away with a placeholder in the
+    // texture. the image is read on a worker and swapped in by uploadFinished()
+    GLuint loadAsync(const char* filename) {
+        auto found = textures.find(filename);
+        if (found != textures.end()) {
+            sharedCount++;
+            return found->second;
+        }
+
+        if (!workers) workers.reset(new ThreadPool());
+        chooseCompressedFormats();
+        if (inFlight == 0) asyncStart = std::chrono::steady_clock::now();
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        uploadPlaceholderTexture(textureID);
+        textures[filename] = textureID;
+        inFlight++;
+
+        std::string name = filename;
+        MipFilter filter = sampling.mipFilter;
+        std::vector<BlockFormat> formats = compressedFormats;
+        workers->submit([this, name, textureID, filter, formats] {
+            std::unique_ptr<TextureData> texture(new TextureData());
+            bool loaded = readOrDecode(name.c_str(), filter, formats, *texture);
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            finished.push_back({ name, textureID, loaded, std::move(texture) });
+        });
+        return textureID;
+    }
+
+    // uploads whatever the workers have finished since the last call, or
+    // the next tiles of it when streaming. call once per frame from the gl
+    // thread, returns how many textures are complete on the gpu now
+    int uploadFinished() {
+        if (inFlight == 0) return 0;
+
+        std::vector<FinishedTexture> ready;
+        {
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            ready.swap(finished);
+        }
+        int completed = 0;
+        for (auto& texture : ready) {
+            if (!texture.loaded) {
+                printf("Failed to load texture: %s\n", texture.filename.c_str());
+                completed++;
+            }
+            else if (streaming && texture.data->compressedLevels.empty()) {
+                // compressed ones are an eighth of the size, they go up directly
+                startStreaming(texture.textureID, std::move(texture.data));
+            }
+            else {
+                upload(texture.textureID, *texture.data);
+                completed++;
+            }
+        }
+        if (streamer.busy()) {
+            completed += streamer.update(streamBudgetBytes);
+        }
+
+        inFlight -= completed;
+        if (completed > 0 && inFlight == 0) {
+            loadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - asyncStart).count();
+        }
+        return completed;
+    }
+
+    // blocks until the workers have decoded every loadAsync() texture, the
+    // uploads still happen in uploadFinished()
+    void waitForDecoding() {
+        if (workers) workers->wait();
+    }
+
+    bool loading() const { return inFlight > 0; }
+
+    void printStats() const {
+        printf("textures:    %d decoded, %d from cache, %d compressed, %d shared, %.1f ms, %.1f MB on the gpu\n",
+            decodedCount.load(), cachedCount.load(), compressedCount.load(), sharedCount, loadMs, uploadedBytes / (1024.0 * 1024.0));
+        if (sampling.mipmaps) {
+            printf("mipmaps:     %s filter, %.1f ms building, anisotropy %.0fx\n", mipFilterName(sampling.mipFilter), mipBuildMs,
+                std::max(appliedAnisotropy, 1.0f));
+        }
+        else {
+            printf("mipmaps:     off\n");
+        }
+        if (streaming) {
+            printf("streaming:   %s, %d tiles, %d fence stalls, %.0f KB per frame\n", streamer.modeName(), streamer.tiles(),
+                streamer.stalls(), streamBudgetBytes / 1024.0);
+        }
+    }
+
+private:
+    struct FinishedTexture {
+        std::string filename;
+        GLuint textureID;
+        bool loaded;
+        std::unique_ptr<TextureData> data;
+    };
+
+    // no gl in here, it runs on the workers too
+    bool readOrDecode(const char* filename, MipFilter filter, const std::vector<BlockFormat>& formats, TextureData& texture) {
+        if (!formats.empty() && readCompressedTexture(filename, formats, texture)) {
+            compressedCount++;
+            return true;
+        }
+        if (readTextureCache(filename, filter, texture)) {
+            cachedCount++;
+            return true;
+        }
+        if (!decodeTexture(filename, filter, texture)) return false;
+        decodedCount++;
+        if (!writeTextureCache(filename, filter, texture)) {
+            printf("Failed to write texture cache: %s\n", textureCachePath(filename, filter).c_str());
+        }
+        return true;
+    }
+
+    // the block formats the gpu takes, in the order they are tried. needs
+    // loadGLExtensions() first, without it nothing is compressed
+    void chooseCompressedFormats() {
+        if (compressedFormatsChosen) return;
+        compressedFormatsChosen = true;
+        if (!sampling.compressed) return;
+        if (glext.hasS3TC) {
+            compressedFormats.push_back(BLOCK_BC1);
+            compressedFormats.push_back(BLOCK_BC3);
+        }
+        if (glext.hasETC2) {
+            compressedFormats.push_back(BLOCK_ETC2_RGB);
+        }
+    }
+
+    float anisotropyToApply() {
+        if (appliedAnisotropy == 0.0f) {
+            appliedAnisotropy = sampling.mipmaps ? std::min(std::max(sampling.anisotropy, 1.0f), maxTextureAnisotropy()) : 1.0f;
+        }
+        return appliedAnisotropy;
+    }
+
+    void countUpload(const TextureData& texture) {
+        mipBuildMs += texture.mipBuildMs;
+        for (int level = 0; level < (sampling.mipmaps ? texture.levels : 1); level++) {
+            uploadedBytes += texture.compressedLevels.empty()
+                ? static_cast<size_t>(mipWidth(texture.width, level)) * mipHeight(texture.height, level) * 4
+                : texture.compressedLevels[level].size;
+        }
+    }
+
+    void upload(GLuint textureID, const TextureData& texture) {
+        uploadTexture(textureID, texture, sampling.mipmaps, anisotropyToApply());
+        countUpload(texture);
+    }
+
+    void startStreaming(GLuint textureID, std::unique_ptr<TextureData> texture) {
+        streamer.init();
+        int levels = sampling.mipmaps ? texture->levels : 1;
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        setTextureSampling(levels, sampling.mipmaps, anisotropyToApply());
+        countUpload(*texture);
+        std::shared_ptr<const TextureData> owner(std::move(texture));
+        streamer.add(textureID, owner->width, owner->height, levels, owner->pixels, owner);
+    }
+
+    std::map<std::string, GLuint> textures;
+    std::mutex finishedMutex;
+    std::vector<FinishedTexture> finished;
+    std::chrono::steady_clock::time_point asyncStart;
+    int inFlight = 0;
+    std::atomic<int> decodedCount{ 0 };
+    std::atomic<int> cachedCount{ 0 };
+    std::atomic<int> compressedCount{ 0 };
+    std::vector<BlockFormat> compressedFormats;
+    bool compressedFormatsChosen = false;
+    size_t uploadedBytes = 0;
+    int sharedCount = 0;
+    double loadMs = 0.0;
+    double mipBuildMs = 0.0;
+    float appliedAnisotropy = 0.0f; // sampling.anisotropy clamped, 0 until the first upload
+    TextureStreamer streamer;
+    std::unique_ptr<ThreadPool> workers; // last, so it is joined before the rest goes away
+};
+
+static TextureCache textureCache;
@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "BlockCompression.h"
+#include "KtxFile.h"
+#include "MipChain.h"
+
+/* Offline texture compressor. Encodes images (the demos' jpegs) into block
+   compressed ktx files with the full mip chain. The demos load
+   <image>.<format>.ktx when the gpu supports the format and fall back to
+   decoding the image otherwise.
+
+   Usage: TextureCompressor [options] image...
+    --format F          bc1, bc3, etc2 or auto (default): bc1 (bc3 with alpha) plus etc2 for opaque images
+    --mip-filter F      box (default) or kaiser, see MipChain.h
+
+   Build: g++ -O2 TextureCompressor.cpp -o TextureCompressor
+*/
+
+const uint32_t GL_ENUM_RGB = 0x1907;
+const uint32_t GL_ENUM_RGBA = 0x1908;
+
+// true if any pixel is not fully opaque
+bool hasAlpha(const unsigned char* pixels, int width, int height) {
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+        if (pixels[i * 4 + 3] != 255) return true;
+    }
+    return false;
+}
+
+bool compressImage(const char* filename, BlockFormat format, const std::vector<unsigned char>& chain, int width, int height) {
+    auto start = std::chrono::steady_clock::now();
+    int levelCount = mipLevelCount(width, height);
+    std::vector<std::vector<unsigned char>> levels(levelCount);
+    size_t total = 0;
+    for (int level = 0; level < levelCount; level++) {
+        int levelWidth = mipWidth(width, level), levelHeight = mipHeight(height, level);
+        levels[level].resize(compressedLevelSize(format, levelWidth, levelHeight));
+        compressLevel(format, chain.data() + mipLevelOffset(width, height, level), levelWidth, levelHeight, levels[level].data());
+        total += levels[level].size();
+    }
+
+    std::string output = std::string(filename) + "." + blockFormatName(format) + ".ktx";
+    uint32_t baseFormat = blockFormatHasAlpha(format) ? GL_ENUM_RGBA : GL_ENUM_RGB;
+    if (!writeKtx(output.c_str(), blockFormatGLEnum(format), baseFormat, width, height, levels)) {
+        printf("Failed to write %s\n", output.c_str());
+        return false;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("  %-28s %8.1f KB (rgba %.1f KB), %.0f ms\n", output.c_str(), total / 1024.0, chain.size() / 1024.0, ms);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* formatName = "auto";
+    MipFilter filter = MIP_FILTER_BOX;
+    std::vector<const char*> images;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            formatName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc) {
+            filter = strcmp(argv[++i], "kaiser") == 0 ? MIP_FILTER_KAISER : MIP_FILTER_BOX;
+        }
+        else {
+            images.push_back(argv[i]);
+        }
+    }
+
+    if (images.empty()) {
+        printf("Usage: TextureCompressor [--format bc1|bc3|etc2|auto] [--mip-filter box|kaiser] image...\n");
+        return 1;
+    }
+
+    bool failed = false;
+    for (const char* filename : images) {
+        int width, height, channels;
+        unsigned char* image = stbi_load(filename, &width, &height, &channels, STBI_rgb_alpha);
+        if (!image) {
+            printf("Failed to load %s\n", filename);
+            failed = true;
+            continue;
+        }
+
+        std::vector<unsigned char> chain(mipChainSize(width, height));
+        memcpy(chain.data(), image, static_cast<size_t>(width) * height * 4);
+        bool alpha = hasAlpha(image, width, height);
+        stbi_image_free(image);
+        buildMipChain(chain.data(), width, height, filter);
+        printf("%s: %dx%d, %d levels, %s mips\n", filename, width, height, mipLevelCount(width, height), mipFilterName(filter));
+
+        std::vector<BlockFormat> formats;
+        if (strcmp(formatName, "bc1") == 0) formats.push_back(BLOCK_BC1);
+        else if (strcmp(formatName, "bc3") == 0) formats.push_back(BLOCK_BC3);
+        else if (strcmp(formatName, "etc2") == 0) formats.push_back(BLOCK_ETC2_RGB);
+        else {
+            // only the etc1 subset of etc2 is implemented, which has no alpha
+            formats.push_back(alpha ? BLOCK_BC3 : BLOCK_BC1);
+            if (!alpha) formats.push_back(BLOCK_ETC2_RGB);
+        }
+
+        for (BlockFormat format : formats) {
+            if (format == BLOCK_ETC2_RGB && alpha) {
+                printf("  etc2 drops the alpha channel of %s\n", filename);
+            }
+            failed = !compressImage(filename, format, chain, width, height) || failed;
+        }
+    }
+    return failed ? 1 : 0;
+}
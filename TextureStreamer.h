@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include "GLExtensions.h"
+#include "MipChain.h"
+
+#ifndef GL_TEXTURE_BASE_LEVEL
+#define GL_TEXTURE_BASE_LEVEL 0x813C
+#endif
+
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+
+// uploads rgba8 mip chains a few 256x256 tiles per frame instead of one big
+// glTexImage2D. levels go up coarsest first and GL_TEXTURE_BASE_LEVEL follows
+// the finest complete one, so a texture sharpens while it streams in.
+// tiles are staged in a ring of pixel buffer slots: one persistently mapped
+// buffer with a fence per slot when the driver has buffer storage, otherwise
+// orphaned and mapped pbos, otherwise plain glTexSubImage2D from memory
+class TextureStreamer {
+public:
+    static const int TILE_SIZE = 256;
+    static const int SLOTS = 4;
+    static const size_t SLOT_BYTES = TILE_SIZE * TILE_SIZE * 4;
+
+    // needs loadGLExtensions() first
+    void init() {
+        if (initialized) return;
+        initialized = true;
+
+        if (glext.hasPersistentBuffers) {
+            glext.genBuffers(1, &buffers[0]);
+            glext.bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[0]);
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glext.bufferStorage(GL_PIXEL_UNPACK_BUFFER, SLOTS * SLOT_BYTES, nullptr, flags);
+            mapped = static_cast<unsigned char*>(glext.mapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, SLOTS * SLOT_BYTES, flags));
+            glext.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (mapped) {
+                mode = PERSISTENT;
+                return;
+            }
+            glext.deleteBuffers(1, &buffers[0]);
+            buffers[0] = 0;
+        }
+        if (glext.hasPixelBuffers) {
+            glext.genBuffers(SLOTS, buffers);
+            mode = PIXEL_BUFFERS;
+        }
+    }
+
+    const char* modeName() const {
+        switch (mode) {
+        case PERSISTENT: return "persistent pbo ring";
+        case PIXEL_BUFFERS: return "pbo ring";
+        default: return "direct";
+        }
+    }
+
+    // the pixels are read later, so owner has to keep them alive. the
+    // texture's sampling is set already
+    void add(GLuint textureID, int width, int height, int levels, const unsigned char* pixels, std::shared_ptr<const void> owner) {
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+        queue.push_back({ textureID, width, height, levels - 1, 0, pixels, std::move(owner) });
+    }
+
+    bool busy() const { return !queue.empty(); }
+
+    // uploads tiles until budgetBytes are sent (at least one tile), returns
+    // how many textures finished
+    int update(size_t budgetBytes) {
+        int finished = 0;
+        size_t sent = 0;
+        while (!queue.empty() && (sent == 0 || sent < budgetBytes)) {
+            Job& job = queue.front();
+            int width = mipWidth(job.width, job.level), height = mipHeight(job.height, job.level);
+            int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE, tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+            int x = (job.tile % tilesX) * TILE_SIZE, y = (job.tile / tilesX) * TILE_SIZE;
+            int tileWidth = std::min(TILE_SIZE, width - x), tileHeight = std::min(TILE_SIZE, height - y);
+
+            glBindTexture(GL_TEXTURE_2D, job.textureID);
+            if (job.tile == 0) {
+                // storage a level at a time, allocating the whole chain at once is a hitch of its own
+                glTexImage2D(GL_TEXTURE_2D, job.level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+            const unsigned char* level = job.pixels + mipLevelOffset(job.width, job.height, job.level);
+            uploadTile(level + (static_cast<size_t>(y) * width + x) * 4, width, job.level, x, y, tileWidth, tileHeight);
+            sent += static_cast<size_t>(tileWidth) * tileHeight * 4;
+            uploadedTiles++;
+
+            if (++job.tile < tilesX * tilesY) continue;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.level);
+            job.tile = 0;
+            if (--job.level < 0) {
+                queue.pop_front();
+                finished++;
+            }
+        }
+        return finished;
+    }
+
+    int tiles() const { return uploadedTiles; }
+    int stalls() const { return fenceStalls; }
+
+private:
+    enum Mode { DIRECT, PIXEL_BUFFERS, PERSISTENT };
+
+    struct Job {
+        GLuint textureID;
+        int width, height;
+        int level;  // the one being uploaded, counts down to 0
+        int tile;   // next tile in it, row by row
+        const unsigned char* pixels;
+        std::shared_ptr<const void> owner;
+    };
+
+    // source points at the tile's first pixel inside a level rowPixels wide
+    void uploadTile(const unsigned char* source, int rowPixels, int level, int x, int y, int width, int height) {
+        if (mode == DIRECT) {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, rowPixels);
+            glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, source);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            return;
+        }
+
+        int slot = nextSlot;
+        nextSlot = (nextSlot + 1) % SLOTS;
+        unsigned char* target;
+        size_t offset = 0;
+        if (mode == PERSISTENT) {
+            // the gpu may still be reading this slot from SLOTS tiles ago
+            if (fences[slot]) {
+                if (glext.clientWaitSync(fences[slot], 0, 0) != GL_ALREADY_SIGNALED) {
+                    fenceStalls++;
+                    glext.clientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+                }
+                glext.deleteSync(fences[slot]);
+                fences[slot] = nullptr;
+            }
+            offset = slot * SLOT_BYTES;
+            target = mapped + offset;
+            glext.bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[0]);
+        }
+        else {
+            // orphaning gives a fresh buffer instead of waiting for the old one
+            glext.bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[slot]);
+            glext.bufferData(GL_PIXEL_UNPACK_BUFFER, SLOT_BYTES, nullptr, GL_STREAM_DRAW);
+            target = static_cast<unsigned char*>(glext.mapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+            if (!target) {
+                glext.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                mode = DIRECT;
+                uploadTile(source, rowPixels, level, x, y, width, height);
+                return;
+            }
+        }
+
+        for (int row = 0; row < height; row++) {
+            memcpy(target + static_cast<size_t>(row) * width * 4, source + static_cast<size_t>(row) * rowPixels * 4, width * 4);
+        }
+        if (mode == PIXEL_BUFFERS) glext.unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+        if (mode == PERSISTENT) fences[slot] = glext.fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glext.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    bool initialized = false;
+    Mode mode = DIRECT;
+    GLuint buffers[SLOTS] = {};
+    unsigned char* mapped = nullptr;
+    SyncHandle fences[SLOTS] = {};
+    int nextSlot = 0;
+    std::deque<Job> queue;
+    int uploadedTiles = 0;
+    int fenceStalls = 0;
+};
@@ -0,0 +1,201 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads pulling jobs off one queue. jobs must not touch
+// gl, only the thread that made the context current may do that.
+// build with -pthread
+class ThreadPool {
+public:
+    // 0 threads = one per hardware thread
+    explicit ThreadPool(int threads = 0) {
+        if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 0; i < threads; i++) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // runs whatever is still queued, then joins
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    // blocks until every submitted job has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return pending == 0; });
+    }
+
+    int size() const { return static_cast<int>(workers.size()); }
+
+private:
+    void work() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending--;
+            }
+            idle.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    int pending = 0; // queued or running
+    bool stopping = false;
+};
+
+// runs parallelFor() batches: every thread owns a deque of task indices and
+// takes from its front, and a thread that runs dry steals from the back of
+// another one, so uneven tasks still keep every thread busy. the calling
+// thread works too, threads = 1 runs everything inline without any threads
+class WorkStealingPool {
+public:
+    // threads includes the caller, 0 = one per hardware thread
+    explicit WorkStealingPool(int threads = 0) {
+        if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 0; i < threads; i++) queues.emplace_back(new TaskQueue());
+        for (int i = 1; i < threads; i++) {
+            workers.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    // calls job(task) for every task in [0, count) and returns when all are
+    // done. each thread starts on its own contiguous share of the range
+    void parallelFor(int count, const std::function<void(int)>& job) {
+        if (count <= 0) return;
+        int threads = size();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->job = &job;
+            remaining = count;
+            for (int t = 0; t < threads; t++) {
+                std::lock_guard<std::mutex> queueLock(queues[t]->mutex);
+                for (int task = count * t / threads; task < count * (t + 1) / threads; task++) {
+                    queues[t]->tasks.push_back(task);
+                }
+            }
+            batch++;
+        }
+        wake.notify_all();
+
+        runTasks(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return remaining == 0; });
+        this->job = nullptr;
+    }
+
+    int size() const { return static_cast<int>(queues.size()); }
+
+    // tasks taken from another thread's deque, over the pool's lifetime
+    long long steals() const { return stolen; }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    void work(int self) {
+        long long seenBatch = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || batch != seenBatch; });
+                if (stopping) return;
+                seenBatch = batch;
+            }
+            runTasks(self);
+        }
+    }
+
+    // own tasks first, then everybody else's, until nothing is left anywhere
+    void runTasks(int self) {
+        int task;
+        while (takeOwn(self, task) || steal(self, task)) {
+            (*job)(task);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0) done.notify_all();
+        }
+    }
+
+    bool takeOwn(int self, int& task) {
+        std::lock_guard<std::mutex> lock(queues[self]->mutex);
+        if (queues[self]->tasks.empty()) return false;
+        task = queues[self]->tasks.front();
+        queues[self]->tasks.pop_front();
+        return true;
+    }
+
+    bool steal(int self, int& task) {
+        for (int offset = 1; offset < size(); offset++) {
+            TaskQueue& victim = *queues[(self + offset) % size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            stolen++;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<TaskQueue>> queues; // [0] belongs to the caller
+    std::vector<std::thread> workers;
+    const std::function<void(int)>* job = nullptr;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    long long batch = 0;
+    int remaining = 0; // tasks not finished yet in this batch
+    std::atomic<long long> stolen{ 0 };
+    bool stopping = false;
+};